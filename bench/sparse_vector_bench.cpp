@@ -0,0 +1,405 @@
+/*  sparse_vector_bench.cpp
+    Microbenchmarks of sparse_vector against std::vector<std::optional<T>> with a free stack,
+    a generational slot map and plf::colony (when plf_colony.h is on the include path).
+
+    Build (Google Benchmark, C++17):
+        c++ -std=c++17 -O2 -DNDEBUG -I.. sparse_vector_bench.cpp -lbenchmark -lpthread -o sparse_vector_bench
+    Add -I<path to plf_colony> to include plf::colony.
+
+    Every benchmark reports time_per_op, seconds per processed element (printed as 7.5n for 7.5 ns).
+    Benchmarks that leave a filled container also report bytes_per_live, footprint divided by live elements.
+*/
+
+#include "../sparse_vector.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+#if __has_include(<plf_colony.h>)
+#   include <plf_colony.h>
+#   define SPARSE_VECTOR_BENCH_COLONY 1
+#endif
+
+namespace {
+    template <std::size_t Size>
+    struct payload {
+        std::uint64_t words[Size / sizeof(std::uint64_t)];
+
+        payload(std::uint64_t v = 0) noexcept {
+            for (auto& w : words)
+                w = v;
+        }
+        [[nodiscard]] std::uint64_t key() const noexcept {
+            return words[0];
+        }
+    };
+
+    inline std::uint64_t key_of(std::uint64_t v) noexcept {
+        return v;
+    }
+    template <std::size_t Size>
+    inline std::uint64_t key_of(const payload<Size>& v) noexcept {
+        return v.key();
+    }
+
+    /*
+        Adapters share one interface:
+            handle_type insert(const T&), void erase(handle_type), T& get(handle_type),
+            template<class F> void for_each(F), void clear(), std::size_t bytes() const, std::size_t live() const
+    */
+
+    template <class T>
+    struct sparse_vector_adapter {
+        typedef T value_type;
+        typedef sv::sparse_vector<T> container_type;
+        typedef typename container_type::size_type handle_type;
+        container_type c;
+
+        handle_type insert(const T& v) {
+            return c.push_free(v);
+        }
+        void erase(handle_type h) {
+            c.erase_at(h);
+        }
+        T& get(handle_type h) {
+            return c[h];
+        }
+        template <class F>
+        void for_each(F f) {
+            for (auto& v : c)
+                f(v);
+        }
+        void clear() {
+            c.clear();
+        }
+        [[nodiscard]] std::size_t bytes() const {
+            return c.capacity() * sizeof(T) + (c.capacity() + 63) / 64 * 8 + c.get_free_cells().capacity() * sizeof(handle_type);
+        }
+        [[nodiscard]] std::size_t live() const {
+            return c.live_count();
+        }
+    };
+
+    template <class T>
+    struct optional_vector_adapter {
+        typedef T value_type;
+        typedef std::size_t handle_type;
+        std::vector<std::optional<T>> c;
+        std::vector<std::size_t> freeIndeces;
+        std::size_t liveCount = 0;
+
+        handle_type insert(const T& v) {
+            ++liveCount;
+            if (freeIndeces.empty()) {
+                c.emplace_back(v);
+                return c.size() - 1;
+            }
+            const std::size_t i = freeIndeces.back();
+            freeIndeces.pop_back();
+            c[i].emplace(v);
+            return i;
+        }
+        void erase(handle_type h) {
+            c[h].reset();
+            freeIndeces.push_back(h);
+            --liveCount;
+        }
+        T& get(handle_type h) {
+            return *c[h];
+        }
+        template <class F>
+        void for_each(F f) {
+            for (auto& v : c)
+                if (v)
+                    f(*v);
+        }
+        void clear() {
+            c.clear();
+            freeIndeces.clear();
+            liveCount = 0;
+        }
+        [[nodiscard]] std::size_t bytes() const {
+            return c.capacity() * sizeof(std::optional<T>) + freeIndeces.capacity() * sizeof(std::size_t);
+        }
+        [[nodiscard]] std::size_t live() const {
+            return liveCount;
+        }
+    };
+
+    // generational slot map, values stay dense and are reached through a slot table
+    template <class T>
+    struct slot_map_adapter {
+        typedef T value_type;
+        struct handle_type {
+            std::uint32_t index;
+            std::uint32_t generation;
+        };
+        struct slot {
+            std::uint32_t denseIndex;
+            std::uint32_t generation;
+        };
+        std::vector<T> values;
+        std::vector<std::uint32_t> owners; // slot of every dense value
+        std::vector<slot> slots;
+        std::vector<std::uint32_t> freeSlots;
+
+        handle_type insert(const T& v) {
+            std::uint32_t s;
+            if (freeSlots.empty()) {
+                s = static_cast<std::uint32_t>(slots.size());
+                slots.push_back(slot{0, 0});
+            } else {
+                s = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            slots[s].denseIndex = static_cast<std::uint32_t>(values.size());
+            values.push_back(v);
+            owners.push_back(s);
+            return handle_type{s, slots[s].generation};
+        }
+        void erase(handle_type h) {
+            const std::uint32_t dense = slots[h.index].denseIndex;
+            values[dense] = values.back();
+            owners[dense] = owners.back();
+            slots[owners[dense]].denseIndex = dense;
+            values.pop_back();
+            owners.pop_back();
+            ++slots[h.index].generation;
+            freeSlots.push_back(h.index);
+        }
+        T& get(handle_type h) {
+            return values[slots[h.index].denseIndex];
+        }
+        template <class F>
+        void for_each(F f) {
+            for (auto& v : values)
+                f(v);
+        }
+        void clear() {
+            values.clear();
+            owners.clear();
+            slots.clear();
+            freeSlots.clear();
+        }
+        [[nodiscard]] std::size_t bytes() const {
+            return values.capacity() * sizeof(T) + owners.capacity() * sizeof(std::uint32_t)
+                + slots.capacity() * sizeof(slot) + freeSlots.capacity() * sizeof(std::uint32_t);
+        }
+        [[nodiscard]] std::size_t live() const {
+            return values.size();
+        }
+    };
+
+#ifdef SPARSE_VECTOR_BENCH_COLONY
+    template <class T>
+    struct colony_adapter {
+        typedef T value_type;
+        typedef typename plf::colony<T>::iterator handle_type;
+        plf::colony<T> c;
+
+        handle_type insert(const T& v) {
+            return c.insert(v);
+        }
+        void erase(handle_type h) {
+            c.erase(h);
+        }
+        T& get(handle_type h) {
+            return *h;
+        }
+        template <class F>
+        void for_each(F f) {
+            for (auto& v : c)
+                f(v);
+        }
+        void clear() {
+            c.clear();
+        }
+        [[nodiscard]] std::size_t bytes() const {
+            return c.memory();
+        }
+        [[nodiscard]] std::size_t live() const {
+            return c.size();
+        }
+    };
+#endif
+
+    void report(benchmark::State& state, std::size_t opsPerIteration) {
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * opsPerIteration));
+        state.counters["time_per_op"] = benchmark::Counter(static_cast<double>(state.iterations() * opsPerIteration),
+            benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    }
+    template <class A>
+    void report_memory(benchmark::State& state, const A& a) {
+        if (a.live() != 0)
+            state.counters["bytes_per_live"] = static_cast<double>(a.bytes()) / static_cast<double>(a.live());
+    }
+
+    // erases holePercent% of n values at random, returns handles of the rest
+    template <class A>
+    std::vector<typename A::handle_type> fill_with_holes(A& a, std::size_t n, std::size_t holePercent) {
+        typedef typename A::value_type value_type;
+        std::vector<typename A::handle_type> handles;
+        handles.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+            handles.push_back(a.insert(value_type(i)));
+        std::mt19937_64 rng(42);
+        std::shuffle(handles.begin(), handles.end(), rng);
+        const std::size_t erased = n * holePercent / 100;
+        for (std::size_t i = 0; i < erased; ++i)
+            a.erase(handles[i]);
+        handles.erase(handles.begin(), handles.begin() + static_cast<std::ptrdiff_t>(erased));
+        return handles;
+    }
+
+    // appends into an empty container, includes every reallocation on the way
+    template <template <class> class AdapterT, class T>
+    void bm_push_free(benchmark::State& state) {
+        const std::size_t n = static_cast<std::size_t>(state.range(0));
+        for (auto _ : state) {
+            AdapterT<T> a;
+            for (std::size_t i = 0; i < n; ++i)
+                benchmark::DoNotOptimize(a.insert(T(i)));
+            benchmark::ClobberMemory();
+        }
+        report(state, n);
+        AdapterT<T> a;
+        for (std::size_t i = 0; i < n; ++i)
+            a.insert(T(i));
+        report_memory(state, a);
+    }
+
+    // refills holes left by erasing every value
+    template <template <class> class AdapterT, class T>
+    void bm_emplace_free(benchmark::State& state) {
+        const std::size_t n = static_cast<std::size_t>(state.range(0));
+        AdapterT<T> a;
+        for (auto _ : state) {
+            state.PauseTiming();
+            a.clear();
+            fill_with_holes(a, n, 100);
+            state.ResumeTiming();
+            for (std::size_t i = 0; i < n; ++i)
+                benchmark::DoNotOptimize(a.insert(T(i)));
+        }
+        report(state, n);
+        report_memory(state, a);
+    }
+
+    template <template <class> class AdapterT, class T>
+    void bm_erase_at(benchmark::State& state) {
+        const std::size_t n = static_cast<std::size_t>(state.range(0));
+        for (auto _ : state) {
+            state.PauseTiming();
+            AdapterT<T> a;
+            auto handles = fill_with_holes(a, n, 0);
+            state.ResumeTiming();
+            for (auto h : handles)
+                a.erase(h);
+            benchmark::ClobberMemory();
+        }
+        report(state, n);
+    }
+
+    template <template <class> class AdapterT, class T>
+    void bm_at(benchmark::State& state) {
+        const std::size_t n = static_cast<std::size_t>(state.range(0));
+        AdapterT<T> a;
+        auto handles = fill_with_holes(a, n, 50);
+        std::uint64_t sum = 0;
+        for (auto _ : state) {
+            for (auto h : handles)
+                sum += key_of(a.get(h));
+            benchmark::DoNotOptimize(sum);
+        }
+        report(state, handles.size());
+        report_memory(state, a);
+    }
+
+    // range(1) is the hole percentage
+    template <template <class> class AdapterT, class T>
+    void bm_iterate(benchmark::State& state) {
+        const std::size_t n = static_cast<std::size_t>(state.range(0));
+        AdapterT<T> a;
+        fill_with_holes(a, n, static_cast<std::size_t>(state.range(1)));
+        for (auto _ : state) {
+            std::uint64_t sum = 0;
+            a.for_each([&sum](const T& v) { sum += key_of(v); });
+            benchmark::DoNotOptimize(sum);
+        }
+        report(state, n);
+        report_memory(state, a);
+    }
+
+    template <template <class> class AdapterT, class T>
+    void bm_copy(benchmark::State& state) {
+        const std::size_t n = static_cast<std::size_t>(state.range(0));
+        AdapterT<T> a;
+        fill_with_holes(a, n, 50);
+        for (auto _ : state) {
+            AdapterT<T> copy(a);
+            benchmark::DoNotOptimize(&copy);
+        }
+        report(state, n);
+    }
+
+    template <template <class> class AdapterT, class T>
+    void bm_clear(benchmark::State& state) {
+        const std::size_t n = static_cast<std::size_t>(state.range(0));
+        for (auto _ : state) {
+            state.PauseTiming();
+            AdapterT<T> a;
+            fill_with_holes(a, n, 50);
+            state.ResumeTiming();
+            a.clear();
+            benchmark::ClobberMemory();
+        }
+        report(state, n);
+    }
+
+    typedef std::uint32_t small_t;
+    typedef std::uint64_t word_t;
+    typedef payload<64> line_t;
+    typedef payload<256> big_t;
+
+    void sizes(benchmark::internal::Benchmark* b) {
+        b->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+    }
+    void densities(benchmark::internal::Benchmark* b) {
+        for (long holes : {0, 50, 90, 99})
+            b->Args({1 << 20, holes});
+    }
+};
+
+#define SPARSE_VECTOR_BENCH_ALL(ADAPTER, T) \
+    BENCHMARK_TEMPLATE(bm_push_free, ADAPTER, T)->Apply(sizes); \
+    BENCHMARK_TEMPLATE(bm_emplace_free, ADAPTER, T)->Apply(sizes); \
+    BENCHMARK_TEMPLATE(bm_erase_at, ADAPTER, T)->Apply(sizes); \
+    BENCHMARK_TEMPLATE(bm_at, ADAPTER, T)->Apply(sizes); \
+    BENCHMARK_TEMPLATE(bm_iterate, ADAPTER, T)->Apply(densities); \
+    BENCHMARK_TEMPLATE(bm_copy, ADAPTER, T)->Apply(sizes); \
+    BENCHMARK_TEMPLATE(bm_clear, ADAPTER, T)->Apply(sizes)
+
+#ifdef SPARSE_VECTOR_BENCH_COLONY
+#   define SPARSE_VECTOR_BENCH_TYPE(T) \
+        SPARSE_VECTOR_BENCH_ALL(sparse_vector_adapter, T); \
+        SPARSE_VECTOR_BENCH_ALL(optional_vector_adapter, T); \
+        SPARSE_VECTOR_BENCH_ALL(slot_map_adapter, T); \
+        SPARSE_VECTOR_BENCH_ALL(colony_adapter, T)
+#else
+#   define SPARSE_VECTOR_BENCH_TYPE(T) \
+        SPARSE_VECTOR_BENCH_ALL(sparse_vector_adapter, T); \
+        SPARSE_VECTOR_BENCH_ALL(optional_vector_adapter, T); \
+        SPARSE_VECTOR_BENCH_ALL(slot_map_adapter, T)
+#endif
+
+SPARSE_VECTOR_BENCH_TYPE(small_t);
+SPARSE_VECTOR_BENCH_TYPE(word_t);
+SPARSE_VECTOR_BENCH_TYPE(line_t);
+SPARSE_VECTOR_BENCH_TYPE(big_t);
+
+BENCHMARK_MAIN();
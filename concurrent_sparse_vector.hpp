@@ -0,0 +1,343 @@
+/*  concurrent_sparse_vector.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef CONCURRENT_SPARSE_VECTOR_HPP_
+#define CONCURRENT_SPARSE_VECTOR_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+#include <atomic>
+
+namespace sv {
+    /*
+        sparse_vector whose push_free, emplace_free and erase_at may be called from many threads without locks.
+
+        Storage is a fixed directory of segments, segment s holds FirstSegment << s slots,
+        so growth allocates the next segment and never moves a value under a reader.
+        Holes are kept in a Treiber stack, its head packs an ABA tag with the index, links live in a per slot atomic array.
+        Occupancy bits are atomic, a value is constructed first and published by setting its bit (release).
+
+        at, exist_at and operator[] are wait-free. Reading an index while another thread erases that same index is
+        a race of the caller, like with any container. clear, copy and iteration are not concurrent.
+        Indices fit in 32 bits.
+    */
+    template <  class T,
+                SPARSE_VECTOR_SIZE_TYPE FirstSegment = 4096,
+                class AllocatorT = std::allocator<T>>
+    class concurrent_sparse_vector {
+        public:
+        typedef T value_type;
+        typedef T& referens;
+        typedef const T& const_referens;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef SPARSE_VECTOR_SIZE_TYPE size_type;
+        static const unsigned max_segments = 32;
+
+        static_assert(FirstSegment != 0 && FirstSegment % details::word_bits == 0 && (FirstSegment & (FirstSegment - 1)) == 0,
+            "FirstSegment must be a power of two and a multiple of 64.");
+
+        private:
+        typedef std::uint32_t link_type;
+        typedef std::atomic<details::bitmap_word> atomic_word;
+        typedef std::atomic<link_type> atomic_link;
+
+        struct segment {
+            atomic_word* exist;
+            atomic_link* next; // free stack link, index + 1, 0 ends the stack
+            pointer values;
+        };
+
+        public:
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<value_type> allocator_type;
+        typedef std::allocator_traits<allocator_type> allocator_traits;
+
+        private:
+        typedef typename allocator_traits::template rebind_alloc<atomic_word> word_allocator_type;
+        typedef typename allocator_traits::template rebind_alloc<atomic_link> link_allocator_type;
+        typedef typename allocator_traits::template rebind_alloc<segment> segment_allocator_type;
+
+        private:
+        std::atomic<segment*> segments_[max_segments];
+        std::atomic<size_type> size_;
+        std::atomic<size_type> liveCount_;
+        std::atomic<std::uint64_t> freeHead_; // tag << 32 | (index + 1)
+        allocator_type allocator_;
+
+        private:
+        [[nodiscard]] static unsigned segment_of(size_type i) noexcept {
+            return details::highest_bit(static_cast<details::bitmap_word>(i / FirstSegment + 1));
+        }
+        [[nodiscard]] static size_type segment_begin(unsigned s) noexcept {
+            return FirstSegment * ((size_type(1) << s) - 1);
+        }
+        [[nodiscard]] static size_type segment_size(unsigned s) noexcept {
+            return FirstSegment << s;
+        }
+        [[nodiscard]] static size_type max_size() noexcept {
+            const size_type bySegments = segment_begin(max_segments - 1) + segment_size(max_segments - 1);
+            const size_type byLinks = static_cast<size_type>(static_cast<link_type>(-1)) - 1;
+            return bySegments < byLinks ? bySegments : byLinks;
+        }
+
+        segment* new_segment(unsigned s) {
+            const size_type count = segment_size(s);
+            segment_allocator_type segmentAllocator(allocator_);
+            word_allocator_type wordAllocator(allocator_);
+            link_allocator_type linkAllocator(allocator_);
+            segment* seg = std::allocator_traits<segment_allocator_type>::allocate(segmentAllocator, 1);
+            seg->exist = nullptr;
+            seg->next = nullptr;
+            seg->values = nullptr;
+            try {
+                seg->exist = std::allocator_traits<word_allocator_type>::allocate(wordAllocator, count / details::word_bits);
+                seg->next = std::allocator_traits<link_allocator_type>::allocate(linkAllocator, count);
+                seg->values = allocator_.allocate(count);
+            } catch (...) {
+                delete_segment(s, seg);
+                throw;
+            }
+            for (size_type w = 0; w < count / details::word_bits; ++w)
+                new(&seg->exist[w])atomic_word(0);
+            for (size_type i = 0; i < count; ++i)
+                new(&seg->next[i])atomic_link(0);
+            return seg;
+        }
+        // storage only, values must be destroyed already
+        void delete_segment(unsigned s, segment* seg) noexcept {
+            const size_type count = segment_size(s);
+            segment_allocator_type segmentAllocator(allocator_);
+            word_allocator_type wordAllocator(allocator_);
+            link_allocator_type linkAllocator(allocator_);
+            if (seg->values != nullptr)
+                allocator_.deallocate(seg->values, count);
+            if (seg->next != nullptr)
+                std::allocator_traits<link_allocator_type>::deallocate(linkAllocator, seg->next, count);
+            if (seg->exist != nullptr)
+                std::allocator_traits<word_allocator_type>::deallocate(wordAllocator, seg->exist, count / details::word_bits);
+            std::allocator_traits<segment_allocator_type>::deallocate(segmentAllocator, seg, 1);
+        }
+        // installs the segment of i if nobody did yet, the loser of the race frees its copy
+        segment& ensure_segment(size_type i) {
+            const unsigned s = segment_of(i);
+            segment* seg = segments_[s].load(std::memory_order_acquire);
+            if (seg != nullptr)
+                return *seg;
+            segment* fresh = new_segment(s);
+            if (segments_[s].compare_exchange_strong(seg, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+                return *fresh;
+            delete_segment(s, fresh);
+            return *seg;
+        }
+        [[nodiscard]] const segment* find_segment(size_type i) const noexcept {
+            return segments_[segment_of(i)].load(std::memory_order_acquire);
+        }
+        [[nodiscard]] bool test(size_type i) const noexcept {
+            const segment* seg = find_segment(i);
+            if (seg == nullptr)
+                return false;
+            const size_type offset = i - segment_begin(segment_of(i));
+            return (seg->exist[offset / details::word_bits].load(std::memory_order_acquire) >> (offset % details::word_bits)) & 1u;
+        }
+        [[nodiscard]] pointer slot(size_type i) const noexcept {
+            return &find_segment(i)->values[i - segment_begin(segment_of(i))];
+        }
+        [[nodiscard]] atomic_link& link(size_type i) const noexcept {
+            return find_segment(i)->next[i - segment_begin(segment_of(i))];
+        }
+        [[nodiscard]] atomic_word& word(size_type i, details::bitmap_word& bit) const noexcept {
+            const size_type offset = i - segment_begin(segment_of(i));
+            bit = details::bitmap_word(1) << (offset % details::word_bits);
+            return find_segment(i)->exist[offset / details::word_bits];
+        }
+
+        void push_hole(size_type i) noexcept {
+            atomic_link& next = link(i);
+            std::uint64_t head = freeHead_.load(std::memory_order_relaxed);
+            std::uint64_t desired;
+            do {
+                next.store(static_cast<link_type>(head), std::memory_order_relaxed);
+                desired = (((head >> 32) + 1) << 32) | static_cast<std::uint64_t>(i + 1);
+            } while (!freeHead_.compare_exchange_weak(head, desired, std::memory_order_release, std::memory_order_relaxed));
+        }
+        // true and index of a hole, or false when the stack is empty
+        bool pop_hole(size_type& index) noexcept {
+            std::uint64_t head = freeHead_.load(std::memory_order_acquire);
+            for (;;) {
+                const link_type top = static_cast<link_type>(head);
+                if (top == 0)
+                    return false;
+                const link_type next = link(top - 1).load(std::memory_order_relaxed); // may be stale, then the tag fails the CAS
+                const std::uint64_t desired = (((head >> 32) + 1) << 32) | next;
+                if (freeHead_.compare_exchange_weak(head, desired, std::memory_order_acquire, std::memory_order_acquire)) {
+                    index = top - 1;
+                    return true;
+                }
+            }
+        }
+        // a hole, or the next index once its segment exists: a bad_alloc of the segment claims nothing,
+        // and size_ never goes past max_size() even for a moment
+        size_type claim_index() {
+            size_type index;
+            if (pop_hole(index))
+                return index;
+            index = size_.load(std::memory_order_relaxed);
+            do {
+                if (index >= max_size())
+                    throw std::length_error("concurrent_sparse_vector is full.");
+                ensure_segment(index);
+            } while (!size_.compare_exchange_weak(index, index + 1, std::memory_order_release, std::memory_order_relaxed));
+            return index;
+        }
+        template<class... ArgsT>
+        void construct_at(size_type index, ArgsT&&... args) {
+            try {
+                new(slot(index))value_type(std::forward<ArgsT>(args)...);
+            } catch (...) {
+                push_hole(index);
+                throw;
+            }
+            details::bitmap_word bit;
+            word(index, bit).fetch_or(bit, std::memory_order_release);
+            liveCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+        void destroy_all() noexcept {
+            for (unsigned s = 0; s < max_segments; ++s) {
+                segment* seg = segments_[s].load(std::memory_order_relaxed);
+                if (seg == nullptr)
+                    continue;
+                for (size_type w = 0; w < segment_size(s) / details::word_bits; ++w) {
+                    details::bitmap_word bits = seg->exist[w].exchange(0, std::memory_order_relaxed);
+                    while (bits != 0) {
+                        seg->values[w * details::word_bits + details::countr_zero(bits)].~value_type();
+                        bits &= bits - 1;
+                    }
+                }
+            }
+        }
+
+        public:
+        concurrent_sparse_vector() : size_(0), liveCount_(0), freeHead_(0), allocator_() {
+            for (unsigned s = 0; s < max_segments; ++s)
+                segments_[s].store(nullptr, std::memory_order_relaxed);
+        }
+        concurrent_sparse_vector(allocator_type allocator) : size_(0), liveCount_(0), freeHead_(0), allocator_(allocator) {
+            for (unsigned s = 0; s < max_segments; ++s)
+                segments_[s].store(nullptr, std::memory_order_relaxed);
+        }
+        concurrent_sparse_vector(const concurrent_sparse_vector&) = delete;
+        concurrent_sparse_vector& operator=(const concurrent_sparse_vector&) = delete;
+
+        public:
+        ~concurrent_sparse_vector() {
+            destroy_all();
+            for (unsigned s = 0; s < max_segments; ++s) {
+                segment* seg = segments_[s].load(std::memory_order_relaxed);
+                if (seg != nullptr)
+                    delete_segment(s, seg);
+            }
+        }
+
+        public:
+        size_type push_free(const_referens val) {
+            const size_type index = claim_index();
+            construct_at(index, val);
+            return index;
+        }
+        template<class... ArgsT>
+        size_type emplace_free(ArgsT&&... args) {
+            const size_type index = claim_index();
+            construct_at(index, std::forward<ArgsT>(args)...);
+            return index;
+        }
+        // clears the bit first, so of two racing erases of one index exactly one succeeds
+        void erase_at(size_type index) {
+            if (index >= size_.load(std::memory_order_acquire) || find_segment(index) == nullptr)
+                throw std::out_of_range("out of concurrent_sparse_vector range on erase_at.");
+            details::bitmap_word bit;
+            atomic_word& w = word(index, bit);
+            if (!(w.fetch_and(~bit, std::memory_order_acq_rel) & bit))
+                throw std::out_of_range("value doesnt exist in concurrent_sparse_vector on this index. erase_at.");
+            slot(index)->~value_type();
+            liveCount_.fetch_sub(1, std::memory_order_relaxed);
+            push_hole(index);
+        }
+        [[nodiscard]] bool exist_at(size_type i) const noexcept {
+            if (size_.load(std::memory_order_acquire) <= i)
+                return false;
+            return test(i);
+        }
+        // not concurrent
+        void clear() {
+            destroy_all();
+            freeHead_.store(0, std::memory_order_relaxed);
+            size_.store(0, std::memory_order_relaxed);
+            liveCount_.store(0, std::memory_order_relaxed);
+        }
+        [[nodiscard]] size_type size() const noexcept {
+            return size_.load(std::memory_order_acquire);
+        }
+        [[nodiscard]] size_type live_count() const noexcept {
+            return liveCount_.load(std::memory_order_relaxed);
+        }
+
+        public:
+        [[nodiscard]] referens operator[](size_type i) noexcept {
+            return *slot(i);
+        }
+        [[nodiscard]] const_referens operator[](size_type i) const noexcept {
+            return *slot(i);
+        }
+        [[nodiscard]] referens at(size_type i) {
+            if (!exist_at(i))
+                throw std::out_of_range("value doesnt exist in concurrent_sparse_vector on this index. at.");
+            return *slot(i);
+        }
+        [[nodiscard]] const_referens at(size_type i) const {
+            if (!exist_at(i))
+                throw std::out_of_range("value doesnt exist in concurrent_sparse_vector on this index. at.");
+            return *slot(i);
+        }
+        // funct(index, value&) for every live value, not concurrent with erase_at
+        template<class FunctT>
+        void for_each_live(FunctT funct) {
+            const size_type size = size_.load(std::memory_order_acquire);
+            for (unsigned s = 0; s < max_segments && segment_begin(s) < size; ++s) {
+                segment* seg = segments_[s].load(std::memory_order_acquire);
+                if (seg == nullptr)
+                    continue;
+                for (size_type w = 0; w < segment_size(s) / details::word_bits; ++w) {
+                    details::bitmap_word bits = seg->exist[w].load(std::memory_order_acquire);
+                    while (bits != 0) {
+                        const size_type offset = w * details::word_bits + details::countr_zero(bits);
+                        funct(segment_begin(s) + offset, seg->values[offset]);
+                        bits &= bits - 1;
+                    }
+                }
+            }
+        }
+    };
+};
+#endif
@@ -0,0 +1,403 @@
+/*  handle_sparse_vector.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef HANDLE_SPARSE_VECTOR_HPP_
+#define HANDLE_SPARSE_VECTOR_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+namespace sv {
+    // index and generation of one value, 64 bits, stays invalid after the value is erased
+    struct sparse_handle {
+        std::uint32_t index;
+        std::uint32_t generation;
+
+        [[nodiscard]] std::uint64_t to_bits() const noexcept {
+            return (static_cast<std::uint64_t>(generation) << 32) | index;
+        }
+        [[nodiscard]] static sparse_handle from_bits(std::uint64_t bits) noexcept {
+            sparse_handle h;
+            h.index = static_cast<std::uint32_t>(bits);
+            h.generation = static_cast<std::uint32_t>(bits >> 32);
+            return h;
+        }
+        [[nodiscard]] bool operator==(const sparse_handle& other) const noexcept {
+            return index == other.index && generation == other.generation;
+        }
+        [[nodiscard]] bool operator!=(const sparse_handle& other) const noexcept {
+            return !(*this == other);
+        }
+    };
+
+    /*
+        Slot map with the sparse_vector interface, push_free gives a handle instead of a bare index.
+
+        Every slot keeps a 32 bit generation right before its value, the low bit is the occupancy:
+        odd while the value lives, even while it is a hole. There is no separate bitmap, the generation is the occupancy.
+        Insert and erase both step it, so a handle taken before erase never matches again
+        and try_get checks occupancy and generation with one compare of one load, on the cache line of the value itself.
+        A slot aliases again only after 2 ^ 31 reuses. Generations survive clear.
+        Holes are reused LIFO, values move on growth like in sparse_vector and never otherwise.
+        Iteration tests the generation of every slot, so it walks holes one by one.
+    */
+    template <  class T,
+                class AllocatorT = std::allocator<T>,
+                template <class...> class ContainerT = SPARSE_VECTOR_DEFAULT_CONTAINER>
+    class handle_sparse_vector {
+        public:
+        typedef sparse_handle handle;
+        typedef T value_type;
+        typedef T& referens;
+        typedef const T& const_referens;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef SPARSE_VECTOR_SIZE_TYPE size_type;
+
+        private:
+        struct slot {
+            std::uint32_t generation;
+            alignas(value_type) unsigned char storage[sizeof(value_type)];
+
+            [[nodiscard]] pointer value() noexcept {
+                return reinterpret_cast<pointer>(storage);
+            }
+            [[nodiscard]] const_pointer value() const noexcept {
+                return reinterpret_cast<const_pointer>(storage);
+            }
+            [[nodiscard]] bool live() const noexcept {
+                return (generation & 1u) != 0;
+            }
+        };
+
+        public:
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<value_type> allocator_type;
+        private:
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<slot> slot_allocator_type;
+        typedef std::allocator_traits<slot_allocator_type> slot_allocator_traits;
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<std::uint32_t> index_allocator_type;
+        typedef ContainerT<std::uint32_t, index_allocator_type> container_type;
+
+        private:
+        slot* slots_;
+        size_type size_;
+        size_type capacity_;
+        size_type liveCount_;
+        slot_allocator_type allocator_;
+        container_type freeIndeces_;
+
+        private:
+        // new slots start at generation 0, old ones keep theirs
+        void reallocate(size_type newCapacity) {
+            slot* newSlots = slot_allocator_traits::allocate(allocator_, newCapacity);
+            size_type i = 0;
+            try {
+                for (; i < size_; ++i) {
+                    newSlots[i].generation = slots_[i].generation;
+                    if (slots_[i].live())
+                        new(newSlots[i].value())value_type(std::move_if_noexcept(*slots_[i].value()));
+                }
+            } catch (...) {
+                for (size_type k = 0; k < i; ++k) {
+                    if (newSlots[k].live())
+                        newSlots[k].value()->~value_type();
+                }
+                slot_allocator_traits::deallocate(allocator_, newSlots, newCapacity);
+                throw;
+            }
+            for (; i < capacity_; ++i)
+                newSlots[i].generation = slots_[i].generation;
+            for (; i < newCapacity; ++i)
+                newSlots[i].generation = 0;
+            release_slots();
+            slots_ = newSlots;
+            capacity_ = newCapacity;
+        }
+        void destroy_live() noexcept {
+            if (std::is_trivially_destructible<value_type>::value)
+                return;
+            for (size_type i = 0; i < size_; ++i) {
+                if (slots_[i].live())
+                    slots_[i].value()->~value_type();
+            }
+        }
+        void release_slots() noexcept {
+            if (slots_ == nullptr)
+                return;
+            destroy_live();
+            slot_allocator_traits::deallocate(allocator_, slots_, capacity_);
+            slots_ = nullptr;
+        }
+        // reuses a hole or appends a slot, the value is built by construct and the generation stepped to odd
+        template<class ConstructFn>
+        handle insert(ConstructFn construct) {
+            const bool reuse = !freeIndeces_.empty();
+            if (!reuse && size_ == capacity_) {
+                if (size_ == max_size())
+                    throw std::length_error("handle_sparse_vector index does not fit in handle.");
+                const std::uint64_t grown = capacity_ == 0 ? 8 : static_cast<std::uint64_t>(capacity_) * 2;
+                reallocate(grown > max_size() ? max_size() : static_cast<size_type>(grown));
+            }
+            const size_type index = reuse ? freeIndeces_.back() : size_;
+            construct(slots_[index].value());
+            if (reuse)
+                freeIndeces_.pop_back();
+            else
+                ++size_;
+            ++liveCount_;
+            handle h;
+            h.index = static_cast<std::uint32_t>(index);
+            h.generation = ++slots_[index].generation;
+            return h;
+        }
+        [[nodiscard]] bool valid(handle h) const noexcept {
+            return h.index < size_ && slots_[h.index].generation == h.generation && (h.generation & 1u);
+        }
+        // generations of the whole capacity are copied, handles of other stay stale in the copy too
+        void copy_from(const handle_sparse_vector& other) {
+            if (other.capacity_ == 0)
+                return;
+            reallocate(other.capacity_);
+            for (size_type i = 0; i < other.capacity_; ++i)
+                slots_[i].generation = other.slots_[i].generation & ~std::uint32_t(1);
+            for (size_type i = 0; i < other.size_; ++i) {
+                if (other.slots_[i].live()) {
+                    new(slots_[i].value())value_type(*other.slots_[i].value());
+                    slots_[i].generation = other.slots_[i].generation;
+                    ++liveCount_;
+                }
+                size_ = i + 1; // the destructor sees what was built on throw
+            }
+            freeIndeces_ = other.freeIndeces_;
+        }
+
+        public:
+        handle_sparse_vector() : slots_(nullptr), size_(0), capacity_(0), liveCount_(0), allocator_(), freeIndeces_(index_allocator_type(allocator_)) {
+        }
+        handle_sparse_vector(allocator_type allocator) : slots_(nullptr), size_(0), capacity_(0), liveCount_(0), allocator_(allocator), freeIndeces_(index_allocator_type(allocator_)) {
+        }
+        handle_sparse_vector(const handle_sparse_vector& other) : handle_sparse_vector(allocator_type(slot_allocator_traits::select_on_container_copy_construction(other.allocator_))) {
+            copy_from(other); // delegated constructor is done, destructor cleans up on throw
+        }
+        handle_sparse_vector(handle_sparse_vector&& other) noexcept : slots_(other.slots_), size_(other.size_), capacity_(other.capacity_), liveCount_(other.liveCount_), allocator_(SPARSE_VECTOR_MOVE(other.allocator_)), freeIndeces_(SPARSE_VECTOR_MOVE(other.freeIndeces_)) {
+            other.slots_ = nullptr;
+            other.size_ = 0;
+            other.capacity_ = 0;
+            other.liveCount_ = 0;
+            other.freeIndeces_.clear();
+        }
+        handle_sparse_vector& operator=(handle_sparse_vector other) noexcept {
+            swap(other);
+            return *this;
+        }
+        ~handle_sparse_vector() {
+            release_slots();
+        }
+
+        public:
+        handle push_free(const_referens val) {
+            return insert([&val](pointer p) { new(p)value_type(val); });
+        }
+        template<class... ArgsT>
+        handle emplace_free(ArgsT&&... args) {
+            return insert([&](pointer p) { new(p)value_type(std::forward<ArgsT>(args)...); });
+        }
+        void erase(handle h) {
+            if (!valid(h))
+                throw std::out_of_range("handle is stale in handle_sparse_vector. erase.");
+            freeIndeces_.push_back(h.index); // may throw, nothing changed yet
+            slots_[h.index].value()->~value_type();
+            ++slots_[h.index].generation;
+            --liveCount_;
+        }
+        // every handle goes stale, indices start from 0 again
+        void clear() {
+            for (size_type i = 0; i < size_; ++i) {
+                if (!slots_[i].live())
+                    continue;
+                slots_[i].value()->~value_type();
+                ++slots_[i].generation;
+            }
+            freeIndeces_.clear();
+            size_ = 0;
+            liveCount_ = 0;
+        }
+        void reserve(size_type newCapacity) {
+            if (newCapacity > max_size())
+                throw std::length_error("handle_sparse_vector index does not fit in handle. reserve.");
+            if (newCapacity > capacity_)
+                reallocate(newCapacity);
+        }
+        void swap(handle_sparse_vector& other) noexcept {
+            using std::swap;
+            swap(slots_, other.slots_);
+            swap(size_, other.size_);
+            swap(capacity_, other.capacity_);
+            swap(liveCount_, other.liveCount_);
+            swap(allocator_, other.allocator_);
+            swap(freeIndeces_, other.freeIndeces_);
+        }
+
+        public:
+        [[nodiscard]] bool contains(handle h) const noexcept {
+            return valid(h);
+        }
+        [[nodiscard]] pointer try_get(handle h) noexcept {
+            return valid(h) ? slots_[h.index].value() : nullptr;
+        }
+        [[nodiscard]] const_pointer try_get(handle h) const noexcept {
+            return valid(h) ? slots_[h.index].value() : nullptr;
+        }
+        [[nodiscard]] referens at(handle h) {
+            if (!valid(h))
+                throw std::out_of_range("handle is stale in handle_sparse_vector. at.");
+            return *slots_[h.index].value();
+        }
+        [[nodiscard]] const_referens at(handle h) const {
+            if (!valid(h))
+                throw std::out_of_range("handle is stale in handle_sparse_vector. at.");
+            return *slots_[h.index].value();
+        }
+        [[nodiscard]] bool exist_at(size_type index) const noexcept {
+            return index < size_ && slots_[index].live();
+        }
+        // handle of the value living on index
+        [[nodiscard]] handle handle_of(size_type index) const {
+            if (!exist_at(index))
+                throw std::out_of_range("value doesnt exist in handle_sparse_vector on this index. handle_of.");
+            handle h;
+            h.index = static_cast<std::uint32_t>(index);
+            h.generation = slots_[index].generation;
+            return h;
+        }
+
+        public:
+        [[nodiscard]] size_type live_count() const noexcept {
+            return liveCount_;
+        }
+        [[nodiscard]] size_type size() const noexcept {
+            return size_;
+        }
+        [[nodiscard]] size_type capacity() const noexcept {
+            return capacity_;
+        }
+        // every index fits in the 32 bits of a handle
+        [[nodiscard]] static constexpr size_type max_size() noexcept {
+            return static_cast<size_type>(static_cast<std::uint32_t>(-1));
+        }
+        [[nodiscard]] allocator_type get_allocator() const noexcept {
+            return allocator_type(allocator_);
+        }
+
+        public:
+        template<class SlotT, class ValueT>
+        struct basic_iterator {
+            public:
+            typedef T value_type;
+            typedef ValueT& reference;
+            typedef ValueT* pointer;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
+
+            private:
+            friend class handle_sparse_vector;
+            SlotT* slots_;
+            size_type index_;
+            size_type end_;
+
+            void skip_holes() noexcept {
+                while (index_ < end_ && !slots_[index_].live())
+                    ++index_;
+            }
+
+            public:
+            basic_iterator() noexcept : slots_(nullptr), index_(0), end_(0) {
+            }
+            basic_iterator(SlotT* slots, size_type index, size_type end) noexcept : slots_(slots), index_(index), end_(end) {
+                skip_holes();
+            }
+
+            public:
+            [[nodiscard]] pointer operator->() const noexcept {
+                return slots_[index_].value();
+            }
+            [[nodiscard]] reference operator*() const noexcept {
+                return *slots_[index_].value();
+            }
+
+            public:
+            basic_iterator& operator++() noexcept {
+                ++index_;
+                skip_holes();
+                return *this;
+            }
+            basic_iterator operator++(int) noexcept {
+                basic_iterator old = *this;
+                ++(*this);
+                return old;
+            }
+
+            public:
+            [[nodiscard]] bool operator==(const basic_iterator& other) const noexcept {
+                return index_ == other.index_;
+            }
+            [[nodiscard]] bool operator!=(const basic_iterator& other) const noexcept {
+                return index_ != other.index_;
+            }
+        };
+        typedef basic_iterator<slot, value_type> iterator;
+        typedef basic_iterator<const slot, const value_type> const_iterator;
+
+        public:
+        [[nodiscard]] iterator begin() noexcept {
+            return iterator(slots_, 0, size_);
+        }
+        [[nodiscard]] iterator end() noexcept {
+            return iterator(slots_, size_, size_);
+        }
+        [[nodiscard]] const_iterator begin() const noexcept {
+            return const_iterator(slots_, 0, size_);
+        }
+        [[nodiscard]] const_iterator end() const noexcept {
+            return const_iterator(slots_, size_, size_);
+        }
+        template<class SlotT, class ValueT>
+        [[nodiscard]] size_type index_of(const basic_iterator<SlotT, ValueT>& i) const noexcept {
+            return i.index_;
+        }
+        template<class SlotT, class ValueT>
+        [[nodiscard]] handle handle_of(const basic_iterator<SlotT, ValueT>& i) const noexcept {
+            handle h;
+            h.index = static_cast<std::uint32_t>(i.index_);
+            h.generation = slots_[i.index_].generation;
+            return h;
+        }
+    };
+
+    template <class T, class AllocatorT, template <class...> class ContainerT>
+    void swap(handle_sparse_vector<T, AllocatorT, ContainerT>& a, handle_sparse_vector<T, AllocatorT, ContainerT>& b) noexcept {
+        a.swap(b);
+    }
+};
+#endif
@@ -0,0 +1,610 @@
+/*  paged_sparse_vector.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef PAGED_SPARSE_VECTOR_HPP_
+#define PAGED_SPARSE_VECTOR_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+#include <atomic>
+
+namespace sv {
+    /*
+        sparse_vector over fixed size pages of PageSize slots.
+        Growth allocates one page and never moves values, so addresses stay valid while the value lives.
+        Every page keeps its own occupancy words and live count, pages without values may be given back with release_empty_pages.
+
+        snapshot() gives a read-only copy in O(pages): pages are shared through reference counts
+        and the first write to a shared page (insert, erase, mutable access) clones only that page.
+        A snapshot may be read, copied and destroyed on other threads while the vector keeps changing,
+        snapshot() itself is called by the thread that writes the vector.
+        Addresses of values on a shared page change on that first write.
+    */
+    template <  class T,
+                SPARSE_VECTOR_SIZE_TYPE PageSize = 4096,
+                class AllocatorT = std::allocator<T>,
+                template <class...> class ContainerT = SPARSE_VECTOR_DEFAULT_CONTAINER>
+    class paged_sparse_vector {
+        public:
+        typedef T value_type;
+        typedef T& referens;
+        typedef const T& const_referens;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef SPARSE_VECTOR_SIZE_TYPE size_type;
+        static const size_type page_size = PageSize;
+
+        static_assert(PageSize != 0 && PageSize % details::word_bits == 0 && (PageSize & (PageSize - 1)) == 0,
+            "PageSize must be a power of two and a multiple of 64.");
+
+        private:
+        struct page {
+            details::bitmap_word exist[PageSize / details::word_bits];
+            size_type liveCount;
+            std::atomic<size_type> refs; // the vector and every snapshot sharing the page
+            alignas(value_type) unsigned char storage[PageSize * sizeof(value_type)];
+
+            [[nodiscard]] pointer value(size_type slot) noexcept {
+                return reinterpret_cast<pointer>(storage) + slot;
+            }
+            [[nodiscard]] const_pointer value(size_type slot) const noexcept {
+                return reinterpret_cast<const_pointer>(storage) + slot;
+            }
+            [[nodiscard]] bool test(size_type slot) const noexcept {
+                return (exist[slot / details::word_bits] >> (slot % details::word_bits)) & 1u;
+            }
+            void set(size_type slot) noexcept {
+                exist[slot / details::word_bits] |= details::bitmap_word(1) << (slot % details::word_bits);
+            }
+            void reset(size_type slot) noexcept {
+                exist[slot / details::word_bits] &= ~(details::bitmap_word(1) << (slot % details::word_bits));
+            }
+        };
+
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<size_type> index_allocator_type;
+        typedef ContainerT<SPARSE_VECTOR_SIZE_TYPE, index_allocator_type> container_type;
+        public:
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<value_type> allocator_type;
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<page> page_allocator_type;
+        typedef std::allocator_traits<page_allocator_type> page_allocator_traits;
+        typedef stack_free_list<size_type, container_type> free_list_type;
+
+        private:
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<page*> table_allocator_type;
+        typedef ContainerT<page*, table_allocator_type> page_table_type;
+
+        private:
+        page_table_type pages_; // nullptr for pages that were released or never needed
+        size_type size_;
+        size_type liveCount_;
+        page_allocator_type allocator_;
+        free_list_type freeIndeces_;
+
+        private:
+        [[nodiscard]] static size_type page_of(size_type i) noexcept {
+            return i / PageSize;
+        }
+        [[nodiscard]] static size_type slot_of(size_type i) noexcept {
+            return i % PageSize;
+        }
+        [[nodiscard]] page* new_page() {
+            page* p = page_allocator_traits::allocate(allocator_, 1);
+            for (size_type w = 0; w < PageSize / details::word_bits; ++w)
+                p->exist[w] = 0;
+            p->liveCount = 0;
+            new(&p->refs)std::atomic<size_type>(1);
+            return p;
+        }
+        void destroy_live(page& p) noexcept {
+            if (p.liveCount == 0)
+                return;
+            for (size_type s = details::scan_words<size_type>(p.exist, 0, PageSize, 0); s < PageSize; s = details::scan_words<size_type>(p.exist, s + 1, PageSize, 0))
+                p.value(s)->~value_type();
+        }
+        void delete_page(page* p) noexcept {
+            destroy_live(*p);
+            page_allocator_traits::deallocate(allocator_, p, 1);
+        }
+        // drops one reference, the last owner destroys the page
+        void release_page(page* p) noexcept {
+            if (p->refs.load(std::memory_order_acquire) == 1 || p->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete_page(p);
+        }
+        void delete_pages() noexcept {
+            for (size_type i = 0; i < pages_.size(); ++i) {
+                if (pages_[i] != nullptr)
+                    release_page(pages_[i]);
+                pages_[i] = nullptr;
+            }
+        }
+        [[nodiscard]] page* clone_page(const page& src) {
+            page* dst = new_page();
+            try {
+                for (size_type s = details::scan_words<size_type>(src.exist, 0, PageSize, 0); s < PageSize; s = details::scan_words<size_type>(src.exist, s + 1, PageSize, 0)) {
+                    new(dst->value(s))value_type(*src.value(s));
+                    dst->set(s);
+                    ++dst->liveCount;
+                }
+            } catch (...) {
+                delete_page(dst);
+                throw;
+            }
+            return dst;
+        }
+        // page of index i, cloned first while a snapshot shares it
+        page& writable_page(size_type i) {
+            page*& p = pages_[page_of(i)];
+            if (p->refs.load(std::memory_order_acquire) != 1) {
+                page* own = clone_page(*p);
+                release_page(p);
+                p = own;
+            }
+            return *p;
+        }
+        page& ensure_page(size_type i) {
+            page*& p = pages_[page_of(i)];
+            if (p == nullptr)
+                p = new_page();
+            return writable_page(i);
+        }
+        void grow_table(size_type newSize) {
+            const size_type pageCount = (newSize + PageSize - 1) / PageSize;
+            if (pages_.size() < pageCount)
+                pages_.resize(pageCount, nullptr);
+        }
+        // reuses a hole or appends a slot, page may still be missing
+        size_type claim_index() {
+            while (!freeIndeces_.empty()) {
+                const size_type index = freeIndeces_.pop(static_cast<pointer>(nullptr), *this, size_);
+                if (index < size_) // bigger ones were cut off by pop_back
+                    return index;
+            }
+            grow_table(size_ + 1);
+            return size_++;
+        }
+        template<class... ArgsT>
+        void construct_at(size_type i, ArgsT&&... args) {
+            page& p = ensure_page(i);
+            new(p.value(slot_of(i)))value_type(std::forward<ArgsT>(args)...);
+            p.set(slot_of(i));
+            ++p.liveCount;
+            ++liveCount_;
+        }
+        void mark_as_free(size_type i) {
+            freeIndeces_.push(static_cast<pointer>(nullptr), i);
+        }
+        [[nodiscard]] bool test(size_type i) const noexcept {
+            const page* p = pages_[page_of(i)];
+            return p != nullptr && p->test(slot_of(i));
+        }
+
+        public:
+        paged_sparse_vector() : pages_(), size_(0), liveCount_(0), allocator_(), freeIndeces_(index_allocator_type(allocator_)) {
+        }
+        paged_sparse_vector(allocator_type allocator) : pages_(table_allocator_type(allocator)), size_(0), liveCount_(0), allocator_(allocator), freeIndeces_(index_allocator_type(allocator_)) {
+        }
+        paged_sparse_vector(const paged_sparse_vector& other) : pages_(other.pages_.size(), nullptr, table_allocator_type(other.allocator_)), size_(other.size_), liveCount_(other.liveCount_), allocator_(other.allocator_), freeIndeces_(other.freeIndeces_, index_allocator_type(allocator_)) {
+            try {
+                for (size_type i = 0; i < pages_.size(); ++i) {
+                    if (other.pages_[i] != nullptr)
+                        pages_[i] = clone_page(*other.pages_[i]);
+                }
+            } catch (...) {
+                delete_pages();
+                throw;
+            }
+        }
+        paged_sparse_vector(paged_sparse_vector&& other) : pages_(SPARSE_VECTOR_MOVE(other.pages_)), size_(other.size_), liveCount_(other.liveCount_), allocator_(SPARSE_VECTOR_MOVE(other.allocator_)), freeIndeces_(SPARSE_VECTOR_MOVE(other.freeIndeces_)) {
+            other.pages_.clear();
+            other.freeIndeces_.clear();
+            other.size_ = 0;
+            other.liveCount_ = 0;
+        }
+        private:
+        struct share_tag {
+        };
+        // same pages as other, one more reference on each, free list is not taken
+        paged_sparse_vector(const paged_sparse_vector& other, share_tag) : pages_(other.pages_), size_(other.size_), liveCount_(other.liveCount_), allocator_(other.allocator_), freeIndeces_(index_allocator_type(allocator_)) {
+            for (size_type i = 0; i < pages_.size(); ++i) {
+                if (pages_[i] != nullptr)
+                    pages_[i]->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        public:
+        paged_sparse_vector(std::initializer_list<value_type> other) : paged_sparse_vector() {
+            grow_table(static_cast<size_type>(other.size()));
+            for (const value_type& value : other) // delegated constructor is done, destructor cleans up on throw
+                construct_at(size_++, value);
+        }
+
+        public:
+        ~paged_sparse_vector() {
+            delete_pages();
+            size_ = 0;
+        }
+
+        public:
+        size_type push_free(const_referens val) {
+            const size_type index = claim_index();
+            construct_at(index, val);
+            return index;
+        }
+        template<class... ArgsT>
+        size_type emplace_free(ArgsT&&... args) {
+            const size_type index = claim_index();
+            construct_at(index, std::forward<ArgsT>(args)...);
+            return index;
+        }
+        void erase_at(size_type index) {
+            if (index >= size_)
+                throw std::out_of_range("out of paged_sparse_vector range on erase_at.");
+            if (!test(index))
+                throw std::out_of_range("value doesnt exist in paged_sparse_vector on this index. erase_at.");
+            page& p = writable_page(index);
+            p.value(slot_of(index))->~value_type();
+            p.reset(slot_of(index));
+            --p.liveCount;
+            --liveCount_;
+            mark_as_free(index);
+        }
+        void pop_back() {
+            if (size_ == 0)
+                throw std::out_of_range("paged_sparse_vector is empty on pop_back.");
+            --size_;
+            if (test(size_)) {
+                page& p = writable_page(size_);
+                p.value(slot_of(size_))->~value_type();
+                p.reset(slot_of(size_));
+                --p.liveCount;
+                --liveCount_;
+            }
+        }
+        template<class FunctT>
+        void feel_free_cells(FunctT funct) {
+            for (size_type i = 0; i < size_; ++i) {
+                if (!test(i))
+                    construct_at(i, funct());
+            }
+            freeIndeces_.clear();
+        }
+        // allocates every page below newCapacity
+        void reserve(size_type newCapacity) {
+            grow_table(newCapacity);
+            for (size_type i = 0; i < newCapacity; i += PageSize) {
+                if (pages_[page_of(i)] == nullptr)
+                    pages_[page_of(i)] = new_page();
+            }
+        }
+        // resize with free cells, pages for them are allocated on first use
+        // shrinking destroys values at newSize and above, a shared page is cloned first like on any other write
+        void resize(size_type newSize) {
+            if (newSize < size_) {
+                for (size_type i = find_next_live(newSize); i < size_; i = find_next_live(i + 1)) {
+                    page& p = writable_page(i);
+                    p.value(slot_of(i))->~value_type();
+                    p.reset(slot_of(i));
+                    --p.liveCount;
+                    --liveCount_;
+                }
+                size_ = newSize;
+                if (freeIndeces_.size() != size_ - liveCount_)
+                    freeIndeces_.prune(static_cast<pointer>(nullptr), size_, size_ - liveCount_);
+                return;
+            }
+            grow_table(newSize);
+            if (freeIndeces_.size() != size_ - liveCount_)
+                freeIndeces_.prune(static_cast<pointer>(nullptr), size_, size_ - liveCount_);
+            for (size_type i = size_; i < newSize; ++i)
+                mark_as_free(i);
+            size_ = newSize;
+        }
+        // gives pages without values back to the allocator, returns how many were released
+        size_type release_empty_pages() noexcept {
+            size_type released = 0;
+            for (size_type i = 0; i < pages_.size(); ++i) {
+                page* p = pages_[i];
+                if (p == nullptr || p->liveCount != 0)
+                    continue;
+                release_page(p);
+                pages_[i] = nullptr;
+                ++released;
+            }
+            while (!pages_.empty() && pages_.back() == nullptr && (pages_.size() - 1) * PageSize >= size_)
+                pages_.pop_back();
+            return released;
+        }
+        [[nodiscard]] bool exist_at(size_type i) const noexcept {
+            if (size_ <= i)
+                return false;
+            return test(i);
+        }
+        template<class... ArgsT>
+        void emplace_at(size_type i, ArgsT&&... args) {
+            if (size_ <= i)
+                throw std::out_of_range("index out of paged_sparse_vector size on emplace_at.");
+            if (test(i))
+                throw std::out_of_range("value already exist in paged_sparse_vector on this index. emplace_at.");
+            freeIndeces_.remove(static_cast<pointer>(nullptr), i); // claim_index must not hand it out again
+            try {
+                construct_at(i, std::forward<ArgsT>(args)...);
+            } catch (...) {
+                mark_as_free(i);
+                throw;
+            }
+        }
+        void clear() {
+            for (size_type i = 0; i < pages_.size(); ++i) {
+                page* p = pages_[i];
+                if (p == nullptr)
+                    continue;
+                if (p->refs.load(std::memory_order_acquire) != 1) { // a snapshot keeps the values
+                    release_page(p);
+                    pages_[i] = nullptr;
+                    continue;
+                }
+                destroy_live(*p);
+                for (size_type w = 0; w < PageSize / details::word_bits; ++w)
+                    p->exist[w] = 0;
+                p->liveCount = 0;
+            }
+            freeIndeces_.clear();
+            size_ = 0;
+            liveCount_ = 0;
+        }
+        [[nodiscard]] size_type size() const noexcept {
+            return size_;
+        }
+        [[nodiscard]] size_type capacity() const noexcept {
+            return static_cast<size_type>(pages_.size()) * PageSize;
+        }
+        [[nodiscard]] size_type live_count() const noexcept {
+            return liveCount_;
+        }
+        [[nodiscard]] size_type free_count() const noexcept {
+            return size_ - liveCount_;
+        }
+        [[nodiscard]] const container_type& get_free_cells() const noexcept {
+            return freeIndeces_.container();
+        }
+
+        public:
+        [[nodiscard]] referens operator[](size_type i) {
+            return *writable_page(i).value(slot_of(i));
+        }
+        [[nodiscard]] const_referens operator[](size_type i) const {
+            return *pages_[page_of(i)]->value(slot_of(i));
+        }
+        [[nodiscard]] referens at(size_type i) {
+            if (size_ <= i)
+                throw std::out_of_range("index out of paged_sparse_vector size on at.");
+            if (!test(i))
+                throw std::out_of_range("value doesnt exist in paged_sparse_vector on this index. at.");
+            return (*this)[i];
+        }
+        [[nodiscard]] const_referens at(size_type i) const {
+            if (size_ <= i)
+                throw std::out_of_range("index out of paged_sparse_vector size on at.");
+            if (!test(i))
+                throw std::out_of_range("value doesnt exist in paged_sparse_vector on this index. at.");
+            return (*this)[i];
+        }
+        // first existing index >= i or size(), pages without values are skipped whole
+        [[nodiscard]] size_type find_next_live(size_type i) const noexcept {
+            while (i < size_) {
+                const size_type first = page_of(i) * PageSize;
+                const size_type last = size_ - first < PageSize ? size_ - first : PageSize;
+                const page* p = pages_[page_of(i)];
+                if (p != nullptr && p->liveCount != 0) {
+                    const size_type s = details::scan_words<size_type>(p->exist, slot_of(i), last, 0);
+                    if (s < last)
+                        return first + s;
+                }
+                i = first + PageSize;
+            }
+            return size_;
+        }
+
+        public:
+        // Iterators keep the index, so they survive growth of the page table.
+        struct iterator {
+            public:
+            typedef T value_type;
+            typedef T& referens;
+            typedef const T& const_referens;
+            typedef T* pointer;
+            typedef const T* const_pointer;
+            typedef T& reference;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
+
+            private:
+            friend class paged_sparse_vector;
+            paged_sparse_vector* owner_;
+            size_type index_;
+
+            public:
+            iterator() noexcept : owner_(nullptr), index_(0) {
+            }
+            iterator(paged_sparse_vector* owner, size_type index) noexcept : owner_(owner), index_(owner->find_next_live(index)) {
+            }
+
+            public:
+            [[nodiscard]] pointer operator->() {
+                return &(*owner_)[index_];
+            }
+            // const access reads through the const operator[], a shared page is not cloned
+            [[nodiscard]] const_pointer operator->() const noexcept {
+                return &static_cast<const paged_sparse_vector&>(*owner_)[index_];
+            }
+            [[nodiscard]] referens operator*() {
+                return (*owner_)[index_];
+            }
+            [[nodiscard]] const_referens operator*() const noexcept {
+                return static_cast<const paged_sparse_vector&>(*owner_)[index_];
+            }
+
+            public:
+            iterator& operator++() noexcept {
+                index_ = owner_->find_next_live(index_ + 1);
+                return *this;
+            }
+            iterator operator++(int) noexcept {
+                iterator old = *this;
+                ++(*this);
+                return old;
+            }
+
+            public:
+            [[nodiscard]] bool operator==(const iterator& other) const noexcept {
+                return index_ == other.index_;
+            }
+            [[nodiscard]] bool operator!=(const iterator& other) const noexcept {
+                return index_ != other.index_;
+            }
+
+        };
+        struct const_iterator {
+            public:
+            typedef T value_type;
+            typedef const value_type& const_referens;
+            typedef const value_type* const_pointer;
+            typedef const value_type* pointer;
+            typedef const value_type& reference;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
+
+            private:
+            friend class paged_sparse_vector;
+            const paged_sparse_vector* owner_;
+            size_type index_;
+
+            public:
+            const_iterator() noexcept : owner_(nullptr), index_(0) {
+            }
+            const_iterator(const paged_sparse_vector* owner, size_type index) noexcept : owner_(owner), index_(owner->find_next_live(index)) {
+            }
+
+            public:
+            [[nodiscard]] const_pointer operator->() const noexcept {
+                return &(*owner_)[index_];
+            }
+            [[nodiscard]] const_referens operator*() const noexcept {
+                return (*owner_)[index_];
+            }
+
+            public:
+            const_iterator& operator++() noexcept {
+                index_ = owner_->find_next_live(index_ + 1);
+                return *this;
+            }
+            const_iterator operator++(int) noexcept {
+                const_iterator old = *this;
+                ++(*this);
+                return old;
+            }
+
+            public:
+            [[nodiscard]] bool operator==(const const_iterator& other) const noexcept {
+                return index_ == other.index_;
+            }
+            [[nodiscard]] bool operator!=(const const_iterator& other) const noexcept {
+                return index_ != other.index_;
+            }
+
+        };
+
+        public:
+        [[nodiscard]] iterator begin() noexcept {
+            return iterator(this, 0);
+        }
+        [[nodiscard]] iterator end() noexcept {
+            return iterator(this, size_);
+        }
+        [[nodiscard]] const_iterator begin() const noexcept {
+            return const_iterator(this, 0);
+        }
+        [[nodiscard]] const_iterator end() const noexcept {
+            return const_iterator(this, size_);
+        }
+        [[nodiscard]] size_type index_of(const iterator& i) const noexcept {
+            return i.index_;
+        }
+        [[nodiscard]] size_type index_of(const const_iterator& i) const noexcept {
+            return i.index_;
+        }
+
+        public:
+        // read-only view of the vector at the time of snapshot(), copies share the pages too
+        class snapshot_type {
+            private:
+            friend class paged_sparse_vector;
+            paged_sparse_vector values_;
+
+            snapshot_type(const paged_sparse_vector& owner) : values_(owner, share_tag()) {
+            }
+
+            public:
+            snapshot_type(const snapshot_type& other) : values_(other.values_, share_tag()) {
+            }
+            snapshot_type(snapshot_type&& other) : values_(SPARSE_VECTOR_MOVE(other.values_)) {
+            }
+
+            public:
+            [[nodiscard]] size_type size() const noexcept {
+                return values_.size();
+            }
+            [[nodiscard]] size_type live_count() const noexcept {
+                return values_.live_count();
+            }
+            [[nodiscard]] bool exist_at(size_type i) const noexcept {
+                return values_.exist_at(i);
+            }
+            [[nodiscard]] const_referens operator[](size_type i) const {
+                return values_[i];
+            }
+            [[nodiscard]] const_referens at(size_type i) const {
+                return values_.at(i);
+            }
+            [[nodiscard]] size_type find_next_live(size_type i) const noexcept {
+                return values_.find_next_live(i);
+            }
+            [[nodiscard]] const_iterator begin() const noexcept {
+                return values_.begin();
+            }
+            [[nodiscard]] const_iterator end() const noexcept {
+                return values_.end();
+            }
+            [[nodiscard]] size_type index_of(const const_iterator& i) const noexcept {
+                return values_.index_of(i);
+            }
+        };
+        // O(pages), shares every page with the vector until one of them writes to it
+        [[nodiscard]] snapshot_type snapshot() const {
+            return snapshot_type(*this);
+        }
+    };
+};
+#endif
@@ -0,0 +1,267 @@
+/*  sharded_sparse_vector.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef SHARDED_SPARSE_VECTOR_HPP_
+#define SHARDED_SPARSE_VECTOR_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace sv {
+    namespace details {
+        // small dense id of the calling thread, given out once per thread
+        inline unsigned thread_ticket() noexcept {
+            static std::atomic<unsigned> next(0);
+            static thread_local unsigned ticket = next.fetch_add(1, std::memory_order_relaxed);
+            return ticket;
+        }
+    };
+
+    /*
+        Front-end over one sparse_vector per shard, every thread inserts into its own shard (thread ticket % shard_count()),
+        so inserts share no cache line and values are first touched, so placed, by the thread that owns them.
+        Top ShardBits bits of an index keep the shard, the rest is the index inside the shard.
+
+        Threading contract:
+        - push_free, emplace_free, flush, flush_all and erase_at of an own shard index write the shard under its lock.
+          With no more threads than shards every shard has one writer and the lock is never contended,
+          more threads than shards (or tickets of recycled pool threads) share shards and take turns.
+        - erase_at of an index of another shard is deferred: the index goes to that shard's lock-free inbox
+          and the shard erases the whole batch on its next push_free or flush. Until then the value stays live.
+        - erase_at of an index that is not live does nothing, on the own shard and deferred alike: a deferred erase has
+          no caller left to throw to, and checking before send would read another thread's shard. An index past
+          the shards throws std::out_of_range on both.
+        - at, exist_at and operator[] route by index without locks, reading a shard is safe only while no thread
+          writes to it (between phases, after a barrier), and a reference stays valid until the next insert into that shard.
+        - live_count, get_shard and destruction are not concurrent.
+    */
+    template <  class T,
+                unsigned ShardBits = 6,
+                class AllocatorT = std::allocator<T>,
+                template <class...> class ContainerT = SPARSE_VECTOR_DEFAULT_CONTAINER>
+    class sharded_sparse_vector {
+        public:
+        typedef sparse_vector<T, AllocatorT, ContainerT> shard_type;
+        typedef typename shard_type::value_type value_type;
+        typedef typename shard_type::referens referens;
+        typedef typename shard_type::const_referens const_referens;
+        typedef typename shard_type::size_type size_type;
+        typedef typename shard_type::allocator_type allocator_type;
+        static const unsigned shard_bits = ShardBits;
+        static const unsigned local_bits = sizeof(size_type) * CHAR_BIT - ShardBits;
+
+        static_assert(ShardBits != 0 && ShardBits < 16, "ShardBits must be in [1, 16).");
+
+        private:
+        struct pending {
+            pending* next;
+            size_type index;
+        };
+        typedef typename std::allocator_traits<allocator_type>::template rebind_alloc<pending> pending_allocator_type;
+
+        struct alignas(64) shard {
+            shard_type values;
+            std::mutex lock; // every write to values
+            std::atomic<pending*> inbox; // erases sent by other threads, newest first
+
+            shard(const allocator_type& allocator) : values(allocator), inbox(nullptr) {
+            }
+        };
+        typedef typename std::allocator_traits<allocator_type>::template rebind_alloc<shard> shard_allocator_type;
+
+        private:
+        shard* shards_;
+        size_type shardCount_;
+        allocator_type allocator_;
+
+        private:
+        // under s.lock, takes the whole inbox at once so there is no ABA, indices that are not live are skipped like in erase_at
+        void drain(shard& s) {
+            pending* node = s.inbox.exchange(nullptr, std::memory_order_acquire);
+            pending_allocator_type pendingAllocator(allocator_);
+            while (node != nullptr) {
+                pending* next = node->next;
+                if (s.values.exist_at(node->index))
+                    s.values.erase_at(node->index);
+                std::allocator_traits<pending_allocator_type>::deallocate(pendingAllocator, node, 1);
+                node = next;
+            }
+        }
+        void send(shard& s, size_type local) {
+            pending_allocator_type pendingAllocator(allocator_);
+            pending* node = std::allocator_traits<pending_allocator_type>::allocate(pendingAllocator, 1);
+            node->index = local;
+            node->next = s.inbox.load(std::memory_order_relaxed);
+            while (!s.inbox.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                ;
+        }
+        size_type encode(size_type shardIndex, size_type local) {
+            if (local >> local_bits) {
+                shards_[shardIndex].values.erase_at(local);
+                throw std::length_error("sharded_sparse_vector shard is full.");
+            }
+            return make_index(shardIndex, local);
+        }
+        [[nodiscard]] shard& shard_at(size_type index) const {
+            const size_type s = shard_of(index);
+            if (s >= shardCount_)
+                throw std::out_of_range("out of sharded_sparse_vector shards on this index.");
+            return shards_[s];
+        }
+
+        public:
+        [[nodiscard]] static size_type shard_of(size_type index) noexcept {
+            return index >> local_bits;
+        }
+        [[nodiscard]] static size_type local_of(size_type index) noexcept {
+            return index & ((size_type(1) << local_bits) - 1);
+        }
+        [[nodiscard]] static size_type make_index(size_type shardIndex, size_type local) noexcept {
+            return (shardIndex << local_bits) | local;
+        }
+
+        public:
+        // shardCount 0 means one shard per hardware thread, the count is clamped to [1, 2 ^ ShardBits]
+        explicit sharded_sparse_vector(size_type shardCount = 0, allocator_type allocator = allocator_type()) : shards_(nullptr), shardCount_(0), allocator_(allocator) {
+            if (shardCount == 0)
+                shardCount = std::thread::hardware_concurrency();
+            if (shardCount == 0)
+                shardCount = 1;
+            if (shardCount > (size_type(1) << ShardBits))
+                shardCount = size_type(1) << ShardBits;
+            shard_allocator_type shardAllocator(allocator_);
+            shards_ = std::allocator_traits<shard_allocator_type>::allocate(shardAllocator, shardCount);
+            try {
+                for (; shardCount_ < shardCount; ++shardCount_)
+                    new(&shards_[shardCount_])shard(allocator_);
+            } catch (...) {
+                while (shardCount_ != 0)
+                    shards_[--shardCount_].~shard();
+                std::allocator_traits<shard_allocator_type>::deallocate(shardAllocator, shards_, shardCount);
+                throw;
+            }
+        }
+        sharded_sparse_vector(const sharded_sparse_vector&) = delete;
+        sharded_sparse_vector& operator=(const sharded_sparse_vector&) = delete;
+
+        public:
+        ~sharded_sparse_vector() {
+            pending_allocator_type pendingAllocator(allocator_);
+            for (size_type s = 0; s < shardCount_; ++s) {
+                pending* node = shards_[s].inbox.load(std::memory_order_acquire);
+                while (node != nullptr) {
+                    pending* next = node->next;
+                    std::allocator_traits<pending_allocator_type>::deallocate(pendingAllocator, node, 1);
+                    node = next;
+                }
+                shards_[s].~shard();
+            }
+            shard_allocator_type shardAllocator(allocator_);
+            std::allocator_traits<shard_allocator_type>::deallocate(shardAllocator, shards_, shardCount_);
+        }
+
+        public:
+        [[nodiscard]] size_type local_shard() const noexcept {
+            return static_cast<size_type>(details::thread_ticket()) % shardCount_;
+        }
+        size_type push_free(const_referens val) {
+            const size_type s = local_shard();
+            std::lock_guard<std::mutex> guard(shards_[s].lock);
+            drain(shards_[s]);
+            return encode(s, shards_[s].values.push_free(val));
+        }
+        template<class... ArgsT>
+        size_type emplace_free(ArgsT&&... args) {
+            const size_type s = local_shard();
+            std::lock_guard<std::mutex> guard(shards_[s].lock);
+            drain(shards_[s]);
+            return encode(s, shards_[s].values.emplace_free(std::forward<ArgsT>(args)...));
+        }
+        // right away on the own shard, deferred to the shard's next write otherwise, an index that is not live is skipped
+        void erase_at(size_type index) {
+            shard& s = shard_at(index);
+            if (&s == &shards_[local_shard()]) {
+                std::lock_guard<std::mutex> guard(s.lock);
+                if (s.values.exist_at(local_of(index)))
+                    s.values.erase_at(local_of(index));
+            } else {
+                send(s, local_of(index));
+            }
+        }
+        // erases everything sent to the calling thread's shard
+        void flush() {
+            shard& s = shards_[local_shard()];
+            std::lock_guard<std::mutex> guard(s.lock);
+            drain(s);
+        }
+        // erases everything sent to every shard
+        void flush_all() {
+            for (size_type s = 0; s < shardCount_; ++s) {
+                std::lock_guard<std::mutex> guard(shards_[s].lock);
+                drain(shards_[s]);
+            }
+        }
+        [[nodiscard]] bool exist_at(size_type index) const noexcept {
+            const size_type s = shard_of(index);
+            return s < shardCount_ && shards_[s].values.exist_at(local_of(index));
+        }
+        [[nodiscard]] referens at(size_type index) {
+            return shard_at(index).values.at(local_of(index));
+        }
+        [[nodiscard]] const_referens at(size_type index) const {
+            return shard_at(index).values.at(local_of(index));
+        }
+        [[nodiscard]] referens operator[](size_type index) noexcept {
+            return shards_[shard_of(index)].values[local_of(index)];
+        }
+        [[nodiscard]] const_referens operator[](size_type index) const noexcept {
+            return shards_[shard_of(index)].values[local_of(index)];
+        }
+
+        public:
+        [[nodiscard]] size_type shard_count() const noexcept {
+            return shardCount_;
+        }
+        [[nodiscard]] shard_type& get_shard(size_type s) noexcept {
+            return shards_[s].values;
+        }
+        [[nodiscard]] const shard_type& get_shard(size_type s) const noexcept {
+            return shards_[s].values;
+        }
+        // not concurrent, deferred erases still count
+        [[nodiscard]] size_type live_count() const noexcept {
+            size_type count = 0;
+            for (size_type s = 0; s < shardCount_; ++s)
+                count += shards_[s].values.live_count();
+            return count;
+        }
+    };
+};
+#endif
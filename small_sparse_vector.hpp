@@ -0,0 +1,238 @@
+/*  small_sparse_vector.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef SMALL_SPARSE_VECTOR_HPP_
+#define SMALL_SPARSE_VECTOR_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+namespace sv {
+    namespace details {
+        // inline storage for N values and their occupancy words, each part is lent out once at a time and only while open is set,
+        // free indices and even values can have the type of a bitmap word, so the type alone can't tell who asks
+        template<class T, SPARSE_VECTOR_SIZE_TYPE N>
+        struct inline_arena {
+            typedef T value_type;
+            static const SPARSE_VECTOR_SIZE_TYPE slots = N;
+            static const SPARSE_VECTOR_SIZE_TYPE words = (N + word_bits - 1) / word_bits;
+
+            alignas(T) unsigned char values[N * sizeof(T)];
+            bitmap_word bits[words];
+            bool valuesLent;
+            bool bitsLent;
+            bool open;
+
+            inline_arena() noexcept : valuesLent(false), bitsLent(false), open(false) {
+            }
+            inline_arena(const inline_arena&) = delete;
+            inline_arena& operator=(const inline_arena&) = delete;
+        };
+
+        // allocator over an inline_arena, requests that fit go inline, bigger ones or a second one go to the heap
+        template<class U, class ArenaT>
+        class arena_allocator {
+            template<class, class> friend class arena_allocator;
+
+            public:
+            typedef U value_type;
+            template<class V>
+            struct rebind {
+                typedef arena_allocator<V, ArenaT> other;
+            };
+
+            private:
+            ArenaT* arena_;
+
+            [[nodiscard]] U* lend_values(std::size_t n, std::true_type) noexcept {
+                if (arena_->valuesLent || n > ArenaT::slots)
+                    return nullptr;
+                arena_->valuesLent = true;
+                return reinterpret_cast<U*>(arena_->values);
+            }
+            [[nodiscard]] U* lend_values(std::size_t, std::false_type) noexcept {
+                return nullptr;
+            }
+            [[nodiscard]] U* lend_bits(std::size_t n, std::true_type) noexcept {
+                if (arena_->bitsLent || n > ArenaT::words)
+                    return nullptr;
+                arena_->bitsLent = true;
+                return reinterpret_cast<U*>(arena_->bits);
+            }
+            [[nodiscard]] U* lend_bits(std::size_t, std::false_type) noexcept {
+                return nullptr;
+            }
+            // the vector reallocates its bitmap before its values, so the words go first
+            [[nodiscard]] U* lend(std::size_t n) noexcept {
+                if (!arena_->open)
+                    return nullptr;
+                U* bits = lend_bits(n, std::integral_constant<bool, std::is_same<U, bitmap_word>::value>());
+                return bits != nullptr ? bits : lend_values(n, std::integral_constant<bool, std::is_same<U, typename ArenaT::value_type>::value>());
+            }
+
+            public:
+            explicit arena_allocator(ArenaT* arena) noexcept : arena_(arena) {
+            }
+            template<class V>
+            arena_allocator(const arena_allocator<V, ArenaT>& other) noexcept : arena_(other.arena_) {
+            }
+
+            public:
+            [[nodiscard]] U* allocate(std::size_t n) {
+                U* inlined = lend(n);
+                return inlined != nullptr ? inlined : std::allocator<U>().allocate(n);
+            }
+            void deallocate(U* p, std::size_t n) noexcept {
+                if (static_cast<void*>(p) == static_cast<void*>(arena_->values))
+                    arena_->valuesLent = false;
+                else if (static_cast<void*>(p) == static_cast<void*>(arena_->bits))
+                    arena_->bitsLent = false;
+                else
+                    std::allocator<U>().deallocate(p, n);
+            }
+
+            template<class V>
+            [[nodiscard]] bool operator==(const arena_allocator<V, ArenaT>& other) const noexcept {
+                return arena_ == other.arena_;
+            }
+            template<class V>
+            [[nodiscard]] bool operator!=(const arena_allocator<V, ArenaT>& other) const noexcept {
+                return arena_ != other.arena_;
+            }
+        };
+
+        // keeps the arena alive before the sparse_vector base is built and after it is gone
+        template<class T, SPARSE_VECTOR_SIZE_TYPE N>
+        struct inline_arena_holder {
+            inline_arena<T, N> arena_;
+        };
+
+        // opens the arena for one reserve or shrink of the vector, nothing else allocates in there
+        template<class ArenaT>
+        class open_arena {
+            ArenaT& arena_;
+
+            public:
+            explicit open_arena(ArenaT& arena) noexcept : arena_(arena) {
+                arena_.open = true;
+            }
+            ~open_arena() {
+                arena_.open = false;
+            }
+            open_arena(const open_arena&) = delete;
+            open_arena& operator=(const open_arena&) = delete;
+        };
+    };
+
+    /*
+        sparse_vector with its first N slots inline, values and occupancy take no allocation while size() stays within N.
+        Free indices go through the same allocator but always to the heap, the inline parts are only lent by reserve at construction
+        and by shrink_to_fit.
+        Past N storage spills to the heap, shrink_to_fit brings it back inline once size() fits again.
+        Copy and move go value by value (the inline slots can't change owner), indices are kept.
+    */
+    template <class T, SPARSE_VECTOR_SIZE_TYPE N>
+    class small_sparse_vector
+        : private details::inline_arena_holder<T, N>,
+          public sparse_vector<T, details::arena_allocator<T, details::inline_arena<T, N>>> {
+        public:
+        typedef sparse_vector<T, details::arena_allocator<T, details::inline_arena<T, N>>> vector_type;
+        typedef typename vector_type::size_type size_type;
+        typedef typename vector_type::value_type value_type;
+        typedef typename vector_type::allocator_type allocator_type;
+        static const size_type inline_capacity = N;
+
+        static_assert(N != 0, "small_sparse_vector needs N > 0.");
+
+        private:
+        typedef details::inline_arena_holder<T, N> holder_type;
+
+        void reserve_inline(size_type capacity) {
+            const details::open_arena<details::inline_arena<T, N>> open(this->arena_);
+            this->reserve(capacity);
+        }
+
+        template<class VectorT, class ConstructFn>
+        void take_values(VectorT& other, ConstructFn construct) {
+            const size_type* none = nullptr;
+            this->restore(other.size(), other.get_bitmap().words(), none, none, construct);
+        }
+
+        public:
+        small_sparse_vector() : holder_type(), vector_type(allocator_type(&this->arena_)) {
+            reserve_inline(N);
+        }
+        small_sparse_vector(const small_sparse_vector& other) : holder_type(), vector_type(allocator_type(&this->arena_)) {
+            reserve_inline(N);
+            take_values(other, [&other](value_type* where, size_type i) { new(where)value_type(other[i]); });
+        }
+        small_sparse_vector(small_sparse_vector&& other) : holder_type(), vector_type(allocator_type(&this->arena_)) {
+            reserve_inline(N);
+            take_values(other, [&other](value_type* where, size_type i) { new(where)value_type(SPARSE_VECTOR_MOVE(other[i])); });
+            other.clear();
+        }
+        small_sparse_vector(std::initializer_list<value_type> values) : holder_type(), vector_type(allocator_type(&this->arena_)) {
+            reserve_inline(static_cast<size_type>(values.size()) > N ? static_cast<size_type>(values.size()) : N);
+            for (const value_type& value : values)
+                this->push_free(value);
+        }
+
+        public:
+        small_sparse_vector& operator=(const small_sparse_vector& other) {
+            if (this != &other)
+                take_values(other, [&other](value_type* where, size_type i) { new(where)value_type(other[i]); });
+            return *this;
+        }
+        small_sparse_vector& operator=(small_sparse_vector&& other) {
+            if (this != &other) {
+                take_values(other, [&other](value_type* where, size_type i) { new(where)value_type(SPARSE_VECTOR_MOVE(other[i])); });
+                other.clear();
+            }
+            return *this;
+        }
+        void swap(small_sparse_vector& other) {
+            small_sparse_vector moved(SPARSE_VECTOR_MOVE(other));
+            other = SPARSE_VECTOR_MOVE(*this);
+            *this = SPARSE_VECTOR_MOVE(moved);
+        }
+        // true while values live in the inline slots
+        [[nodiscard]] bool is_inline() const noexcept {
+            return static_cast<const void*>(this->data()) == static_cast<const void*>(this->arena_.values);
+        }
+        // gives heap storage back, moving values inline when they fit
+        void shrink_to_fit() {
+            this->trim_trailing_holes();
+            if (this->capacity() > N) {
+                const details::open_arena<details::inline_arena<T, N>> open(this->arena_);
+                this->shrink_to(N);
+            }
+        }
+    };
+
+    template <class T, SPARSE_VECTOR_SIZE_TYPE N>
+    void swap(small_sparse_vector<T, N>& a, small_sparse_vector<T, N>& b) {
+        a.swap(b);
+    }
+};
+#endif
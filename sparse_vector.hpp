@@ -24,7 +24,7 @@
 */
 
 #ifndef SPARSE_VECTOR_HPP_
-#define SPARSE_VECTPR_HPP_ 1
+#define SPARSE_VECTOR_HPP_ 1
 
 #ifndef SPARSE_VECTOR_DEFAULT_CONTAINER
 #   include <vector>
@@ -41,9 +41,39 @@
 #   define SPARSE_VECTOR_MOVE std::move
 #endif
 
+// Define SPARSE_VECTOR_ENABLE_STATS to count growth, churn and free list depth in every sparse_vector (see stats()).
+// Without it counters and the allocation hook do not exist and cost nothing.
+#if (defined SPARSE_VECTOR_ENABLE_STATS)
+#   define SPARSE_VECTOR_STAT(...) __VA_ARGS__
+#else
+#   define SPARSE_VECTOR_STAT(...)
+#endif
+
+// constexpr on what C++20 allows in constant evaluation (construct_at, destroy_at, changing the active union member)
+#if ((defined __cplusplus) && (__cplusplus >= 202002L))
+#   include <bit>
+#   define SPARSE_VECTOR_CONSTEXPR20 constexpr
+#else
+#   define SPARSE_VECTOR_CONSTEXPR20
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
 #include <type_traits>
+#include <utility>
 #include <exception>
+#include <stdexcept>
 #include <initializer_list>
+#include <iterator>
+
+#if (defined _MSC_VER) && !(defined __clang__)
+#   include <intrin.h>
+#endif
 
 namespace sv {
     namespace details {
@@ -58,11 +88,1065 @@ namespace sv {
             new(&dst)U(src);
             src.~U();
         }
+
+        typedef std::uint64_t bitmap_word;
+        static const unsigned word_bits = 64;
+
+        // index of lowest set bit, word MUST NOT be zero
+        inline SPARSE_VECTOR_CONSTEXPR20 unsigned countr_zero(bitmap_word word) noexcept {
+#if ((defined __cplusplus) && (__cplusplus >= 202002L))
+            return static_cast<unsigned>(std::countr_zero(word));
+#elif (defined __GNUC__) || (defined __clang__)
+            return static_cast<unsigned>(__builtin_ctzll(word));
+#elif (defined _MSC_VER) && (defined _M_X64)
+            unsigned long index;
+            _BitScanForward64(&index, word);
+            return static_cast<unsigned>(index);
+#else
+            unsigned index = 0;
+            while (!(word & 1u)) {
+                word >>= 1;
+                ++index;
+            }
+            return index;
+#endif
+        }
+        // index of highest set bit, word MUST NOT be zero
+        inline unsigned highest_bit(bitmap_word word) noexcept {
+#if (defined __GNUC__) || (defined __clang__)
+            return 63u - static_cast<unsigned>(__builtin_clzll(word));
+#elif (defined _MSC_VER) && (defined _M_X64)
+            unsigned long index;
+            _BitScanReverse64(&index, word);
+            return static_cast<unsigned>(index);
+#else
+            unsigned index = 0;
+            while (word >>= 1)
+                ++index;
+            return index;
+#endif
+        }
+        // bits [0, bit] set
+        inline bitmap_word mask_through(unsigned bit) noexcept {
+            return bit + 1 == word_bits ? ~bitmap_word(0) : (bitmap_word(1) << (bit + 1)) - 1;
+        }
+
+        // first set bit (or zero bit, when flip is all ones) in [i, end) or end
+        template<class SizeT>
+        SPARSE_VECTOR_CONSTEXPR20 SizeT scan_words(const bitmap_word* words, SizeT i, SizeT end, bitmap_word flip) noexcept {
+            if (i >= end)
+                return end;
+            SizeT w = i / word_bits;
+            const SizeT lastWord = (end - 1) / word_bits;
+            bitmap_word bits = (words[w] ^ flip) & (~bitmap_word(0) << (i % word_bits));
+            while (bits == 0) {
+                if (w == lastWord)
+                    return end;
+                bits = words[++w] ^ flip;
+            }
+            const SizeT found = w * word_bits + countr_zero(bits);
+            return found < end ? found : end;
+        }
+        // one past the last set bit in [0, end) or 0
+        template<class SizeT>
+        SizeT scan_words_reverse(const bitmap_word* words, SizeT end) noexcept {
+            if (end == 0)
+                return 0;
+            SizeT w = (end - 1) / word_bits;
+            bitmap_word bits = words[w] & mask_through(static_cast<unsigned>((end - 1) % word_bits));
+            while (bits == 0) {
+                if (w == 0)
+                    return 0;
+                bits = words[--w];
+            }
+            return w * word_bits + highest_bit(bits) + 1;
+        }
+
+        // A::reallocate(pointer, oldCapacity, newCapacity)
+        template<class A, class = void>
+        struct has_reallocate : std::false_type {
+        };
+        template<class A>
+        struct has_reallocate<A, decltype(static_cast<void>(std::declval<A&>().reallocate(
+            std::declval<typename std::allocator_traits<A>::pointer>(),
+            std::declval<typename std::allocator_traits<A>::size_type>(),
+            std::declval<typename std::allocator_traits<A>::size_type>())))> : std::true_type {
+        };
+        // B::touch(index), bitmaps that track changes
+        template<class B, class = void>
+        struct has_touch : std::false_type {
+        };
+        template<class B>
+        struct has_touch<B, decltype(static_cast<void>(std::declval<B&>().touch(std::declval<typename B::size_type>())))> : std::true_type {
+        };
+    };
+
+    // Values that may be moved with memcpy, the source is not destroyed after.
+    // Specialize it for types that are not trivially copyable but still relocate bytewise (unique_ptr-like handles).
+    template <class T>
+    struct is_trivially_relocatable : std::integral_constant<bool, std::is_trivially_copyable<T>::value> {
+    };
+
+    // malloc backed allocator with reallocate, so sparse_vector of trivially relocatable values
+    // grows through realloc, which extends the block in place when it can (and uses mremap for big blocks on glibc).
+    template <class T>
+    struct malloc_allocator {
+        typedef T value_type;
+        template<class U>
+        struct rebind {
+            typedef malloc_allocator<U> other;
+        };
+
+        malloc_allocator() noexcept {
+        }
+        template<class U>
+        malloc_allocator(const malloc_allocator<U>&) noexcept {
+        }
+
+        [[nodiscard]] T* allocate(std::size_t n) {
+            static_assert(alignof(T) <= alignof(std::max_align_t), "malloc_allocator cant provide this alignment.");
+            void* p = std::malloc(n * sizeof(T));
+            if (p == nullptr && n != 0)
+                throw std::bad_alloc();
+            return static_cast<T*>(p);
+        }
+        void deallocate(T* p, std::size_t) noexcept {
+            std::free(p);
+        }
+        // contents are moved bytewise, old pointer is invalid after success
+        [[nodiscard]] T* reallocate(T* p, std::size_t, std::size_t n) {
+            void* grown = std::realloc(p, n * sizeof(T));
+            if (grown == nullptr && n != 0)
+                throw std::bad_alloc();
+            return static_cast<T*>(grown);
+        }
+
+        template<class U>
+        [[nodiscard]] bool operator==(const malloc_allocator<U>&) const noexcept {
+            return true;
+        }
+        template<class U>
+        [[nodiscard]] bool operator!=(const malloc_allocator<U>&) const noexcept {
+            return false;
+        }
+    };
+
+    // One bit per slot, set while the slot holds a live value.
+    // Does not own its allocator, owner passes it to every (de)allocating call.
+    template <class SizeT>
+    class flat_bitmap {
+        public:
+        typedef SizeT size_type;
+        typedef details::bitmap_word word_type;
+
+        private:
+        word_type* words_;
+
+        public:
+        [[nodiscard]] static size_type words_for(size_type bits) noexcept {
+            return static_cast<size_type>(bits / details::word_bits + (bits % details::word_bits != 0)); // no overflow near max of size_type
+        }
+
+        public:
+        flat_bitmap() noexcept : words_(nullptr) {
+        }
+
+        public:
+        // all bits are zero after allocate
+        template<class WordAllocatorT>
+        void allocate(WordAllocatorT& allocator, size_type bits) {
+            const size_type count = words_for(bits);
+            words_ = count == 0 ? nullptr : std::allocator_traits<WordAllocatorT>::allocate(allocator, count);
+            for (size_type i = 0; i < count; ++i)
+                words_[i] = 0;
+        }
+        template<class WordAllocatorT>
+        void deallocate(WordAllocatorT& allocator, size_type bits) noexcept {
+            if (words_ != nullptr)
+                std::allocator_traits<WordAllocatorT>::deallocate(allocator, words_, words_for(bits));
+            words_ = nullptr;
+        }
+        // keeps first oldBits bits, new bits are zero
+        template<class WordAllocatorT>
+        void reallocate(WordAllocatorT& allocator, size_type oldBits, size_type newBits) {
+            const size_type oldCount = words_for(oldBits);
+            const size_type newCount = words_for(newBits);
+            if (oldCount == newCount)
+                return;
+            word_type* newWords = std::allocator_traits<WordAllocatorT>::allocate(allocator, newCount);
+            size_type i = 0;
+            for (; i < oldCount && i < newCount; ++i)
+                newWords[i] = words_[i];
+            for (; i < newCount; ++i)
+                newWords[i] = 0;
+            deallocate(allocator, oldBits);
+            words_ = newWords;
+        }
+        template<class WordAllocatorT>
+        void copy_from(WordAllocatorT& allocator, const flat_bitmap& other, size_type bits) {
+            allocate(allocator, bits);
+            const size_type count = words_for(bits);
+            for (size_type i = 0; i < count; ++i)
+                words_[i] = other.words_[i];
+        }
+        // forgets storage without deallocating, used after ownership was moved
+        void release() noexcept {
+            words_ = nullptr;
+        }
+
+        public:
+        [[nodiscard]] bool test(size_type i) const noexcept {
+            return (words_[i / details::word_bits] >> (i % details::word_bits)) & 1u;
+        }
+        void set(size_type i) noexcept {
+            words_[i / details::word_bits] |= word_type(1) << (i % details::word_bits);
+        }
+        void reset(size_type i) noexcept {
+            words_[i / details::word_bits] &= ~(word_type(1) << (i % details::word_bits));
+        }
+        // zeroes bits [0, bits)
+        void reset_all(size_type bits) noexcept {
+            const size_type count = words_for(bits);
+            for (size_type i = 0; i < count; ++i)
+                words_[i] = 0;
+        }
+        // first set bit in [i, end) or end, skips 64 holes per step
+        [[nodiscard]] size_type find_next(size_type i, size_type end) const noexcept {
+            return details::scan_words<size_type>(words_, i, end, 0);
+        }
+        // first zero bit in [i, end) or end
+        [[nodiscard]] size_type find_next_zero(size_type i, size_type end) const noexcept {
+            return details::scan_words<size_type>(words_, i, end, ~word_type(0));
+        }
+        // one past the last set bit in [0, end) or 0
+        [[nodiscard]] size_type trailing_end(size_type end) const noexcept {
+            return details::scan_words_reverse<size_type>(words_, end);
+        }
+        [[nodiscard]] const word_type* words() const noexcept {
+            return words_;
+        }
+    };
+
+    // flat_bitmap plus summary levels, bit j of level l is set while word j of level l - 1 is not zero.
+    // find_next costs O(log64 capacity) no matter how many holes are in between.
+    // All levels live in one allocation, level 0 is laid out exactly like flat_bitmap.
+    template <class SizeT>
+    class hierarchical_bitmap {
+        public:
+        typedef SizeT size_type;
+        typedef details::bitmap_word word_type;
+        static const unsigned max_levels = (sizeof(size_type) * 8 + 5) / 6;
+
+        private:
+        word_type* levels_[max_levels];
+        size_type counts_[max_levels]; // words per level
+        unsigned depth_;
+
+        public:
+        [[nodiscard]] static size_type words_for(size_type bits) noexcept {
+            return static_cast<size_type>(bits / details::word_bits + (bits % details::word_bits != 0)); // no overflow near max of size_type
+        }
+        [[nodiscard]] static size_type total_words_for(size_type bits) noexcept {
+            size_type count = words_for(bits);
+            size_type total = count;
+            while (count > 1) {
+                count = words_for(count);
+                total += count;
+            }
+            return total;
+        }
+
+        public:
+        hierarchical_bitmap() noexcept : depth_(0) {
+            levels_[0] = nullptr;
+            counts_[0] = 0;
+        }
+
+        public:
+        // all bits are zero after allocate
+        template<class WordAllocatorT>
+        void allocate(WordAllocatorT& allocator, size_type bits) {
+            const size_type total = total_words_for(bits);
+            word_type* block = total == 0 ? nullptr : std::allocator_traits<WordAllocatorT>::allocate(allocator, total);
+            for (size_type i = 0; i < total; ++i)
+                block[i] = 0;
+            depth_ = 1;
+            levels_[0] = block;
+            counts_[0] = words_for(bits);
+            while (counts_[depth_ - 1] > 1) {
+                levels_[depth_] = levels_[depth_ - 1] + counts_[depth_ - 1];
+                counts_[depth_] = words_for(counts_[depth_ - 1]);
+                ++depth_;
+            }
+        }
+        template<class WordAllocatorT>
+        void deallocate(WordAllocatorT& allocator, size_type bits) noexcept {
+            if (depth_ != 0 && levels_[0] != nullptr)
+                std::allocator_traits<WordAllocatorT>::deallocate(allocator, levels_[0], total_words_for(bits));
+            depth_ = 0;
+            levels_[0] = nullptr;
+            counts_[0] = 0;
+        }
+        // keeps first oldBits bits, new bits are zero
+        template<class WordAllocatorT>
+        void reallocate(WordAllocatorT& allocator, size_type oldBits, size_type newBits) {
+            hierarchical_bitmap grown;
+            grown.allocate(allocator, newBits);
+            const size_type count = counts_[0] < grown.counts_[0] ? counts_[0] : grown.counts_[0];
+            for (size_type w = 0; w < count; ++w) {
+                grown.levels_[0][w] = levels_[0][w];
+                if (levels_[0][w] != 0)
+                    grown.mark_word(w);
+            }
+            deallocate(allocator, oldBits);
+            *this = grown;
+        }
+        template<class WordAllocatorT>
+        void copy_from(WordAllocatorT& allocator, const hierarchical_bitmap& other, size_type bits) {
+            allocate(allocator, bits);
+            const size_type total = total_words_for(bits);
+            for (size_type i = 0; i < total; ++i)
+                levels_[0][i] = other.levels_[0][i];
+        }
+        // forgets storage without deallocating, used after ownership was moved
+        void release() noexcept {
+            depth_ = 0;
+            levels_[0] = nullptr;
+            counts_[0] = 0;
+        }
+
+        public:
+        [[nodiscard]] bool test(size_type i) const noexcept {
+            return (levels_[0][i / details::word_bits] >> (i % details::word_bits)) & 1u;
+        }
+        void set(size_type i) noexcept {
+            word_type& word = levels_[0][i / details::word_bits];
+            const bool wasEmpty = word == 0;
+            word |= word_type(1) << (i % details::word_bits);
+            if (wasEmpty)
+                mark_word(i / details::word_bits);
+        }
+        void reset(size_type i) noexcept {
+            size_type index = i;
+            for (unsigned l = 0; l < depth_; ++l) {
+                word_type& word = levels_[l][index / details::word_bits];
+                word &= ~(word_type(1) << (index % details::word_bits));
+                if (word != 0)
+                    return;
+                index /= details::word_bits;
+            }
+        }
+        // zeroes bits [0, bits) and every summary above them
+        void reset_all(size_type bits) noexcept {
+            size_type count = words_for(bits);
+            for (unsigned l = 0; l < depth_ && count != 0; ++l) {
+                for (size_type w = 0; w < count; ++w)
+                    levels_[l][w] = 0;
+                count = words_for(count);
+            }
+        }
+        // first set bit in [i, end) or end
+        [[nodiscard]] size_type find_next(size_type i, size_type end) const noexcept {
+            if (i >= end || depth_ == 0)
+                return end;
+            size_type pos = i; // bit position inside level l
+            unsigned l = 0;
+            word_type bits;
+            for (;;) {
+                const size_type w = pos / details::word_bits;
+                if (w >= counts_[l])
+                    return end;
+                bits = levels_[l][w] & (~word_type(0) << (pos % details::word_bits));
+                if (bits != 0) {
+                    pos = w * details::word_bits + details::countr_zero(bits);
+                    break;
+                }
+                if (l + 1 == depth_)
+                    return end;
+                pos = w + 1;
+                ++l;
+            }
+            while (l != 0) { // every marked word below is guaranteed to be non zero
+                --l;
+                pos = pos * details::word_bits + details::countr_zero(levels_[l][pos]);
+            }
+            return pos < end ? pos : end;
+        }
+        // first zero bit in [i, end) or end, summaries track non empty words only so this one is linear
+        [[nodiscard]] size_type find_next_zero(size_type i, size_type end) const noexcept {
+            return details::scan_words<size_type>(levels_[0], i, end, ~word_type(0));
+        }
+        // one past the last set bit in [0, end) or 0
+        [[nodiscard]] size_type trailing_end(size_type end) const noexcept {
+            if (end == 0 || depth_ == 0)
+                return 0;
+            size_type pos = end - 1; // last candidate bit inside level l
+            unsigned l = 0;
+            for (;;) {
+                const size_type w = pos / details::word_bits;
+                const word_type bits = levels_[l][w] & details::mask_through(static_cast<unsigned>(pos % details::word_bits));
+                if (bits != 0) {
+                    pos = w * details::word_bits + details::highest_bit(bits);
+                    break;
+                }
+                if (w == 0)
+                    return 0;
+                pos = w - 1;
+                ++l;
+            }
+            while (l != 0) {
+                --l;
+                pos = pos * details::word_bits + details::highest_bit(levels_[l][pos]);
+            }
+            return pos + 1;
+        }
+        [[nodiscard]] const word_type* words() const noexcept {
+            return levels_[0];
+        }
+
+        private:
+        // word w of level 0 became non zero
+        void mark_word(size_type w) noexcept {
+            size_type index = w;
+            for (unsigned l = 1; l < depth_; ++l) {
+                word_type& word = levels_[l][index / details::word_bits];
+                const bool wasEmpty = word == 0;
+                word |= word_type(1) << (index % details::word_bits);
+                if (!wasEmpty)
+                    return;
+                index /= details::word_bits;
+            }
+        }
+    };
+
+    // flat_bitmap plus a packed array of live indices and a back pointer per slot (sparse set),
+    // set and reset keep both in O(1) with swap and pop, so live values are walked in O(live count) without a branch per hole:
+    //     for (const size_type* i = v.get_bitmap().live_begin(); i != v.get_bitmap().live_end(); ++i) use(v[*i]);
+    // Order of live_begin is not the index order, it changes on every reset.
+    template <class SizeT>
+    class dense_index_bitmap {
+        public:
+        typedef SizeT size_type;
+        typedef details::bitmap_word word_type;
+
+        private:
+        flat_bitmap<SizeT> bits_;
+        size_type* dense_;  // live indices, [0, count_)
+        size_type* sparse_; // position of slot i in dense_, valid while i is live
+        size_type count_;
+
+        template<class WordAllocatorT>
+        struct index_allocator {
+            typedef typename std::allocator_traits<WordAllocatorT>::template rebind_alloc<size_type> type;
+        };
+
+        public:
+        dense_index_bitmap() noexcept : bits_(), dense_(nullptr), sparse_(nullptr), count_(0) {
+        }
+
+        public:
+        template<class WordAllocatorT>
+        void allocate(WordAllocatorT& allocator, size_type bits) {
+            typename index_allocator<WordAllocatorT>::type indexAllocator(allocator);
+            typedef std::allocator_traits<typename index_allocator<WordAllocatorT>::type> index_traits;
+            size_type* dense = bits == 0 ? nullptr : index_traits::allocate(indexAllocator, bits);
+            size_type* sparse = nullptr;
+            try {
+                sparse = bits == 0 ? nullptr : index_traits::allocate(indexAllocator, bits);
+                bits_.allocate(allocator, bits);
+            } catch (...) {
+                if (sparse != nullptr)
+                    index_traits::deallocate(indexAllocator, sparse, bits);
+                if (dense != nullptr)
+                    index_traits::deallocate(indexAllocator, dense, bits);
+                throw;
+            }
+            dense_ = dense;
+            sparse_ = sparse;
+            count_ = 0;
+        }
+        template<class WordAllocatorT>
+        void deallocate(WordAllocatorT& allocator, size_type bits) noexcept {
+            typename index_allocator<WordAllocatorT>::type indexAllocator(allocator);
+            typedef std::allocator_traits<typename index_allocator<WordAllocatorT>::type> index_traits;
+            if (dense_ != nullptr)
+                index_traits::deallocate(indexAllocator, dense_, bits);
+            if (sparse_ != nullptr)
+                index_traits::deallocate(indexAllocator, sparse_, bits);
+            bits_.deallocate(allocator, bits);
+            dense_ = nullptr;
+            sparse_ = nullptr;
+            count_ = 0;
+        }
+        // live indices must be below newBits
+        template<class WordAllocatorT>
+        void reallocate(WordAllocatorT& allocator, size_type oldBits, size_type newBits) {
+            typename index_allocator<WordAllocatorT>::type indexAllocator(allocator);
+            typedef std::allocator_traits<typename index_allocator<WordAllocatorT>::type> index_traits;
+            size_type* dense = newBits == 0 ? nullptr : index_traits::allocate(indexAllocator, newBits);
+            size_type* sparse = nullptr;
+            try {
+                sparse = newBits == 0 ? nullptr : index_traits::allocate(indexAllocator, newBits);
+                bits_.reallocate(allocator, oldBits, newBits);
+            } catch (...) {
+                if (sparse != nullptr)
+                    index_traits::deallocate(indexAllocator, sparse, newBits);
+                if (dense != nullptr)
+                    index_traits::deallocate(indexAllocator, dense, newBits);
+                throw;
+            }
+            for (size_type i = 0; i < count_; ++i) {
+                dense[i] = dense_[i];
+                sparse[dense_[i]] = i;
+            }
+            if (dense_ != nullptr)
+                index_traits::deallocate(indexAllocator, dense_, oldBits);
+            if (sparse_ != nullptr)
+                index_traits::deallocate(indexAllocator, sparse_, oldBits);
+            dense_ = dense;
+            sparse_ = sparse;
+        }
+        template<class WordAllocatorT>
+        void copy_from(WordAllocatorT& allocator, const dense_index_bitmap& other, size_type bits) {
+            allocate(allocator, bits);
+            for (size_type i = 0; i < other.count_; ++i)
+                set(other.dense_[i]);
+        }
+        void release() noexcept {
+            bits_.release();
+            dense_ = nullptr;
+            sparse_ = nullptr;
+            count_ = 0;
+        }
+
+        public:
+        [[nodiscard]] bool test(size_type i) const noexcept {
+            return bits_.test(i);
+        }
+        void set(size_type i) noexcept {
+            if (bits_.test(i))
+                return;
+            bits_.set(i);
+            sparse_[i] = count_;
+            dense_[count_++] = i;
+        }
+        void reset(size_type i) noexcept {
+            if (!bits_.test(i))
+                return;
+            bits_.reset(i);
+            const size_type last = dense_[--count_];
+            dense_[sparse_[i]] = last;
+            sparse_[last] = sparse_[i];
+        }
+        void reset_all(size_type bits) noexcept {
+            bits_.reset_all(bits);
+            count_ = 0;
+        }
+        [[nodiscard]] size_type find_next(size_type i, size_type end) const noexcept {
+            return bits_.find_next(i, end);
+        }
+        [[nodiscard]] size_type find_next_zero(size_type i, size_type end) const noexcept {
+            return bits_.find_next_zero(i, end);
+        }
+        [[nodiscard]] size_type trailing_end(size_type end) const noexcept {
+            return bits_.trailing_end(end);
+        }
+        [[nodiscard]] const word_type* words() const noexcept {
+            return bits_.words();
+        }
+
+        public:
+        [[nodiscard]] const size_type* live_begin() const noexcept {
+            return dense_;
+        }
+        [[nodiscard]] const size_type* live_end() const noexcept {
+            return dense_ + count_;
+        }
+    };
+
+    // InnerT occupancy plus a dirty bit per slot, set by every insert, erase and clear and by sparse_vector::touch
+    // (mutable at and operator[] touch too), so replicas get only what changed since clear_dirty:
+    //     send_size(v.size()); v.for_each_dirty([&](size_type i) { v.exist_at(i) ? send(i, cv[i]) : send_hole(i); }); v.clear_dirty();
+    // Use it as the BitmapT of sparse_vector through an alias, tracked_flat_bitmap is the flat one.
+    template <class SizeT, class InnerT = flat_bitmap<SizeT>>
+    class change_tracking_bitmap {
+        public:
+        typedef SizeT size_type;
+        typedef details::bitmap_word word_type;
+        typedef InnerT inner_type;
+
+        private:
+        inner_type live_;
+        flat_bitmap<size_type> dirty_;
+
+        public:
+        change_tracking_bitmap() noexcept : live_(), dirty_() {
+        }
+
+        public:
+        template<class WordAllocatorT>
+        void allocate(WordAllocatorT& allocator, size_type bits) {
+            live_.allocate(allocator, bits);
+            try {
+                dirty_.allocate(allocator, bits);
+            } catch (...) {
+                live_.deallocate(allocator, bits);
+                throw;
+            }
+        }
+        template<class WordAllocatorT>
+        void deallocate(WordAllocatorT& allocator, size_type bits) noexcept {
+            live_.deallocate(allocator, bits);
+            dirty_.deallocate(allocator, bits);
+        }
+        template<class WordAllocatorT>
+        void reallocate(WordAllocatorT& allocator, size_type oldBits, size_type newBits) {
+            live_.reallocate(allocator, oldBits, newBits);
+            try {
+                dirty_.reallocate(allocator, oldBits, newBits);
+            } catch (...) {
+                live_.reallocate(allocator, newBits, oldBits);
+                throw;
+            }
+        }
+        template<class WordAllocatorT>
+        void copy_from(WordAllocatorT& allocator, const change_tracking_bitmap& other, size_type bits) {
+            live_.copy_from(allocator, other.live_, bits);
+            try {
+                dirty_.copy_from(allocator, other.dirty_, bits);
+            } catch (...) {
+                live_.deallocate(allocator, bits);
+                throw;
+            }
+        }
+        void release() noexcept {
+            live_.release();
+            dirty_.release();
+        }
+
+        public:
+        [[nodiscard]] bool test(size_type i) const noexcept {
+            return live_.test(i);
+        }
+        void set(size_type i) noexcept {
+            live_.set(i);
+            dirty_.set(i);
+        }
+        void reset(size_type i) noexcept {
+            live_.reset(i);
+            dirty_.set(i);
+        }
+        // the cleared slots are changes too
+        void reset_all(size_type bits) noexcept {
+            live_.reset_all(bits);
+            for (size_type i = 0; i < bits; ++i)
+                dirty_.set(i);
+        }
+        [[nodiscard]] size_type find_next(size_type i, size_type end) const noexcept {
+            return live_.find_next(i, end);
+        }
+        [[nodiscard]] size_type find_next_zero(size_type i, size_type end) const noexcept {
+            return live_.find_next_zero(i, end);
+        }
+        [[nodiscard]] size_type trailing_end(size_type end) const noexcept {
+            return live_.trailing_end(end);
+        }
+        [[nodiscard]] const word_type* words() const noexcept {
+            return live_.words();
+        }
+        [[nodiscard]] const inner_type& inner() const noexcept {
+            return live_;
+        }
+
+        public:
+        void touch(size_type i) noexcept {
+            dirty_.set(i);
+        }
+        [[nodiscard]] bool is_dirty(size_type i) const noexcept {
+            return dirty_.test(i);
+        }
+        // first dirty slot in [i, end) or end
+        [[nodiscard]] size_type find_next_dirty(size_type i, size_type end) const noexcept {
+            return dirty_.find_next(i, end);
+        }
+        void clear_dirty(size_type bits) noexcept {
+            dirty_.reset_all(bits);
+        }
+        [[nodiscard]] const word_type* dirty_words() const noexcept {
+            return dirty_.words();
+        }
+    };
+    template <class SizeT>
+    using tracked_flat_bitmap = change_tracking_bitmap<SizeT>;
+
+    /*
+        Free list policies. sparse_vector builds them with the index allocator (rebound from its own allocator)
+            FreeListT(allocator), FreeListT(other, allocator), FreeListT(move(other), allocator)
+        and calls
+            empty(), size(), clear(),
+            push(data, i)                   - slot i was just destroyed or added as a hole,
+            pop(data, bitmap, size)         - index of a hole to reuse, list is not empty,
+            remove(data, i)                 - hole i below size is about to be filled in place by emplace_at,
+            for_each(data, bitmap, size, fn) - fn(i) for every listed index, the one pop returns next first,
+            transfer(dst, src)              - holes were moved from src storage to dst storage,
+            prune(data, size, holes)        - drop every index >= size, holes are left below it.
+        After size() shrinks the list may still hold indices >= size(), pop may return them and sparse_vector drops them.
+        A listed index below size() is always a hole, pop never hands out a live slot.
+    */
+
+    // LIFO over ContainerT, the hottest hole is reused first
+    template <class SizeT, class ContainerT>
+    class stack_free_list {
+        public:
+        typedef SizeT size_type;
+        typedef ContainerT container_type;
+
+        private:
+        container_type indeces_;
+
+        public:
+        stack_free_list() : indeces_() {
+        }
+        template<class AllocatorT>
+        explicit stack_free_list(const AllocatorT& allocator) noexcept : indeces_(allocator) {
+        }
+        template<class AllocatorT>
+        stack_free_list(const stack_free_list& other, const AllocatorT& allocator) : indeces_(other.indeces_, allocator) {
+        }
+        template<class AllocatorT>
+        stack_free_list(stack_free_list&& other, const AllocatorT& allocator) : indeces_(SPARSE_VECTOR_MOVE(other.indeces_), allocator) {
+            other.indeces_.clear();
+        }
+
+        public:
+        [[nodiscard]] bool empty() const noexcept {
+            return indeces_.empty();
+        }
+        [[nodiscard]] size_type size() const noexcept {
+            return static_cast<size_type>(indeces_.size());
+        }
+        void clear() noexcept {
+            indeces_.clear();
+        }
+        template<class PointerT>
+        void push(PointerT, size_type i) {
+            indeces_.push_back(i);
+        }
+        template<class PointerT, class BitmapT>
+        size_type pop(PointerT, const BitmapT&, size_type) {
+            const size_type index = indeces_.back();
+            indeces_.pop_back();
+            return index;
+        }
+        template<class PointerT, class BitmapT, class IndexFn>
+        void for_each(PointerT, const BitmapT&, size_type, IndexFn fn) const {
+            typename container_type::const_iterator it = indeces_.end();
+            while (it != indeces_.begin())
+                fn(*--it);
+        }
+        // searched from the top, the hole filled by emplace_at is usually a recent one
+        template<class PointerT>
+        void remove(PointerT, size_type i) {
+            typename container_type::iterator it = indeces_.end();
+            while (it != indeces_.begin()) {
+                if (*--it == i) {
+                    indeces_.erase(it);
+                    return;
+                }
+            }
+        }
+        template<class PointerT, class ConstPointerT>
+        void transfer(PointerT, ConstPointerT) noexcept {
+        }
+        template<class PointerT>
+        void prune(PointerT, size_type size, size_type) {
+            indeces_.erase(std::remove_if(indeces_.begin(), indeces_.end(), [size](size_type i) { return i >= size; }), indeces_.end());
+        }
+        [[nodiscard]] const container_type& container() const noexcept {
+            return indeces_;
+        }
+    };
+
+    // LIFO linked through the dead cells themselves, next index is stored in the bytes of the destroyed value.
+    // Never allocates, push and pop are O(1) and noexcept. Needs sizeof(T) >= sizeof(size_type).
+    template <class SizeT, class ContainerT>
+    class intrusive_free_list {
+        public:
+        typedef SizeT size_type;
+        static const size_type npos = static_cast<size_type>(-1);
+
+        private:
+        size_type head_;
+        size_type count_;
+
+        template<class PointerT>
+        static size_type load(PointerT data, size_type i) noexcept {
+            size_type next;
+            std::memcpy(&next, static_cast<const void*>(&data[i]), sizeof(size_type));
+            return next;
+        }
+        template<class PointerT>
+        static void store(PointerT data, size_type i, size_type next) noexcept {
+            static_assert(sizeof(data[i]) >= sizeof(size_type), "intrusive_free_list needs sizeof(T) >= sizeof(size_type).");
+            std::memcpy(static_cast<void*>(&data[i]), &next, sizeof(size_type));
+        }
+
+        public:
+        intrusive_free_list() noexcept : head_(npos), count_(0) {
+        }
+        template<class AllocatorT>
+        explicit intrusive_free_list(const AllocatorT&) noexcept : head_(npos), count_(0) {
+        }
+        template<class AllocatorT>
+        intrusive_free_list(const intrusive_free_list& other, const AllocatorT&) noexcept : head_(other.head_), count_(other.count_) {
+        }
+        template<class AllocatorT>
+        intrusive_free_list(intrusive_free_list&& other, const AllocatorT&) noexcept : head_(other.head_), count_(other.count_) {
+            other.clear();
+        }
+        intrusive_free_list(const intrusive_free_list& other) noexcept : head_(other.head_), count_(other.count_) {
+        }
+        intrusive_free_list(intrusive_free_list&& other) noexcept : head_(other.head_), count_(other.count_) {
+            other.clear();
+        }
+        intrusive_free_list& operator=(const intrusive_free_list& other) noexcept {
+            head_ = other.head_;
+            count_ = other.count_;
+            return *this;
+        }
+
+        public:
+        [[nodiscard]] bool empty() const noexcept {
+            return count_ == 0;
+        }
+        [[nodiscard]] size_type size() const noexcept {
+            return count_;
+        }
+        void clear() noexcept {
+            head_ = npos;
+            count_ = 0;
+        }
+        template<class PointerT>
+        void push(PointerT data, size_type i) noexcept {
+            store(data, i, head_);
+            head_ = i;
+            ++count_;
+        }
+        template<class PointerT, class BitmapT>
+        size_type pop(PointerT data, const BitmapT&, size_type) noexcept {
+            const size_type index = head_;
+            head_ = load(data, index);
+            --count_;
+            return index;
+        }
+        template<class PointerT, class BitmapT, class IndexFn>
+        void for_each(PointerT data, const BitmapT&, size_type, IndexFn fn) const {
+            for (size_type i = head_; i != npos; i = load(data, i))
+                fn(i);
+        }
+        // O(holes) walk, the link of i must be read before a value is built over it
+        template<class PointerT>
+        void remove(PointerT data, size_type i) noexcept {
+            if (head_ == i) {
+                head_ = load(data, i);
+                --count_;
+                return;
+            }
+            for (size_type prev = head_; prev != npos;) {
+                const size_type next = load(data, prev);
+                if (next == i) {
+                    store(data, prev, load(data, i));
+                    --count_;
+                    return;
+                }
+                prev = next;
+            }
+        }
+        // links live inside the cells, so they travel with the storage
+        template<class PointerT, class ConstPointerT>
+        void transfer(PointerT dst, ConstPointerT src) noexcept {
+            for (size_type i = head_; i != npos; i = load(src, i))
+                std::memcpy(static_cast<void*>(&dst[i]), static_cast<const void*>(&src[i]), sizeof(size_type));
+        }
+        // relinks kept holes in their old order
+        template<class PointerT>
+        void prune(PointerT data, size_type size, size_type) noexcept {
+            size_type tail = npos;
+            size_type i = head_;
+            clear();
+            while (i != npos) {
+                const size_type next = load(data, i);
+                if (i < size) {
+                    if (tail == npos)
+                        head_ = i;
+                    else
+                        store(data, tail, i);
+                    tail = i;
+                    ++count_;
+                }
+                i = next;
+            }
+            if (tail != npos)
+                store(data, tail, npos);
+        }
     };
 
+    // Lowest hole first, found in the occupancy bitmap with find_next_zero starting at a lower bound hint.
+    // Live values gather at the front and the tail empties out, so trimming can give it back.
+    template <class SizeT, class ContainerT>
+    class lowest_index_free_list {
+        public:
+        typedef SizeT size_type;
+
+        private:
+        size_type first_; // no hole below this index
+        size_type count_;
+
+        public:
+        lowest_index_free_list() noexcept : first_(0), count_(0) {
+        }
+        template<class AllocatorT>
+        explicit lowest_index_free_list(const AllocatorT&) noexcept : first_(0), count_(0) {
+        }
+        template<class AllocatorT>
+        lowest_index_free_list(const lowest_index_free_list& other, const AllocatorT&) noexcept : first_(other.first_), count_(other.count_) {
+        }
+        template<class AllocatorT>
+        lowest_index_free_list(lowest_index_free_list&& other, const AllocatorT&) noexcept : first_(other.first_), count_(other.count_) {
+            other.clear();
+        }
+        lowest_index_free_list(const lowest_index_free_list& other) noexcept : first_(other.first_), count_(other.count_) {
+        }
+        lowest_index_free_list(lowest_index_free_list&& other) noexcept : first_(other.first_), count_(other.count_) {
+            other.clear();
+        }
+        lowest_index_free_list& operator=(const lowest_index_free_list& other) noexcept {
+            first_ = other.first_;
+            count_ = other.count_;
+            return *this;
+        }
+
+        public:
+        [[nodiscard]] bool empty() const noexcept {
+            return count_ == 0;
+        }
+        [[nodiscard]] size_type size() const noexcept {
+            return count_;
+        }
+        void clear() noexcept {
+            first_ = 0;
+            count_ = 0;
+        }
+        template<class PointerT>
+        void push(PointerT, size_type i) noexcept {
+            if (i < first_)
+                first_ = i;
+            ++count_;
+        }
+        template<class PointerT, class BitmapT>
+        size_type pop(PointerT, const BitmapT& bitmap, size_type size) noexcept {
+            const size_type index = bitmap.find_next_zero(first_, size);
+            first_ = index + 1;
+            --count_;
+            return index;
+        }
+        template<class PointerT, class BitmapT, class IndexFn>
+        void for_each(PointerT, const BitmapT& bitmap, size_type size, IndexFn fn) const {
+            for (size_type i = bitmap.find_next_zero(first_, size); i < size; i = bitmap.find_next_zero(i + 1, size))
+                fn(i);
+        }
+        // the bitmap is the list, a filled hole only leaves the count
+        template<class PointerT>
+        void remove(PointerT, size_type) noexcept {
+            --count_;
+        }
+        template<class PointerT, class ConstPointerT>
+        void transfer(PointerT, ConstPointerT) noexcept {
+        }
+        template<class PointerT>
+        void prune(PointerT, size_type size, size_type holes) noexcept {
+            if (first_ > size)
+                first_ = size;
+            count_ = holes;
+        }
+    };
+
+    // Growth policies, next_capacity(capacity, sizeof(value_type)) gives the capacity of the next reallocation, always more than capacity.
+    // Counted in 64 bits whatever the index type is, sparse_vector clamps the result to its max_size().
+    // x2, a vector without storage starts from 2
+    struct doubling_growth {
+        [[nodiscard]] static std::uint64_t next_capacity(std::uint64_t capacity, std::size_t) noexcept {
+            return capacity != 0 ? capacity * 2 : 2;
+        }
+    };
+    // x Numerator / Denominator (factor_growth<3, 2> is x1.5), wastes less on big vectors for a few more reallocations
+    template <std::uint64_t Numerator = 3, std::uint64_t Denominator = 2>
+    struct factor_growth {
+        static_assert(Denominator != 0 && Numerator > Denominator, "factor_growth needs a factor above 1.");
+
+        [[nodiscard]] static std::uint64_t next_capacity(std::uint64_t capacity, std::size_t) noexcept {
+            const std::uint64_t grown = capacity / Denominator * Numerator + capacity % Denominator * Numerator / Denominator;
+            return grown > capacity + 1 ? grown : capacity + 2;
+        }
+    };
+    // + Step slots, memory overhead is bounded by Step, inserts are no longer amortized O(1)
+    template <std::uint64_t Step>
+    struct fixed_growth {
+        static_assert(Step != 0, "fixed_growth needs Step > 0.");
+
+        [[nodiscard]] static std::uint64_t next_capacity(std::uint64_t capacity, std::size_t) noexcept {
+            return capacity + Step;
+        }
+    };
+    // GrowthT, then values of vectors of at least PageBytes are rounded up to whole pages (2 MiB huge pages by default),
+    // so a huge page backed allocator (see sparse_vector_huge_pages.hpp) has no partial page at the tail
+    template <class GrowthT = doubling_growth, std::size_t PageBytes = std::size_t(2) << 20>
+    struct page_rounded_growth {
+        static_assert(PageBytes != 0 && (PageBytes & (PageBytes - 1)) == 0, "page_rounded_growth needs a power of 2 page.");
+
+        [[nodiscard]] static std::uint64_t next_capacity(std::uint64_t capacity, std::size_t valueSize) noexcept {
+            const std::uint64_t grown = GrowthT::next_capacity(capacity, valueSize);
+            const std::uint64_t bytes = grown * valueSize;
+            if (bytes < PageBytes)
+                return grown;
+            const std::uint64_t rounded = ((bytes + PageBytes - 1) & ~static_cast<std::uint64_t>(PageBytes - 1)) / valueSize;
+            return rounded > grown ? rounded : grown;
+        }
+    };
+
+    // Counters of sparse_vector::stats(), all zero unless SPARSE_VECTOR_ENABLE_STATS is defined.
+    struct sparse_vector_stats {
+        std::uint64_t reallocations;
+        std::uint64_t bytesMoved;   // bytes of values handed to the relocation of every reallocation
+        std::uint64_t holeReuses;   // inserts that took a hole
+        std::uint64_t tailAppends;  // inserts that took a new slot at the tail
+        std::uint64_t erases;       // values destroyed by erase_at, erase_batch and pop_back
+        std::uint64_t peakSize;
+        std::uint64_t freeListPeak; // deepest free list seen
+        // current state, filled by stats() always
+        std::uint64_t size;
+        std::uint64_t liveCount;
+        double holeRatio;           // holes / size, 0 when empty
+
+        sparse_vector_stats() noexcept : reallocations(0), bytesMoved(0), holeReuses(0), tailAppends(0), erases(0),
+            peakSize(0), freeListPeak(0), size(0), liveCount(0), holeRatio(0) {
+        }
+    };
+    // Passed to the allocation hook after storage was allocated or reallocated.
+    struct sparse_vector_allocation_event {
+        std::uint64_t oldCapacity;
+        std::uint64_t newCapacity;
+        std::uint64_t bytes;        // values and occupancy words of newCapacity slots
+    };
+    typedef void (*sparse_vector_allocation_hook)(void* context, const sparse_vector_allocation_event& event);
+
     template <  class T,
                 class AllocatorT = std::allocator<T>,
-                template <class...> class ContainerT = SPARSE_VECTOR_DEFAULT_CONTAINER>
+                template <class...> class ContainerT = SPARSE_VECTOR_DEFAULT_CONTAINER,
+                template <class> class BitmapT = flat_bitmap,
+                template <class, class> class FreeListT = stack_free_list,
+                class GrowthT = doubling_growth,
+                class SizeT = SPARSE_VECTOR_SIZE_TYPE>
     class sparse_vector {
         public:
         typedef T value_type;
@@ -70,34 +1154,54 @@ namespace sv {
         typedef const T& const_referens;
         typedef T* pointer;
         typedef const T* const_pointer;
-        typedef SPARSE_VECTOR_SIZE_TYPE size_type;
+        typedef SizeT size_type;
+        typedef BitmapT<size_type> bitmap_type;
 
-        protected:
-        struct value_info {
-            public:
-            value_type value;
-            bool exist;
+        static_assert(std::is_unsigned<size_type>::value, "sparse_vector index type must be unsigned.");
 
-        };
+        // every allocation goes through AllocatorT rebound, free indices included, so a std::pmr arena holds the whole vector
+        typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<value_type> allocator_type;
+        typedef std::allocator_traits<allocator_type> allocator_traits;
+        typedef typename allocator_traits::template rebind_alloc<details::bitmap_word> word_allocator_type;
+        typedef typename allocator_traits::template rebind_alloc<size_type> index_allocator_type;
 
         private:
-        typedef ContainerT<SPARSE_VECTOR_SIZE_TYPE> container_type;
+        typedef ContainerT<size_type, index_allocator_type> container_type;
+        // counts given by callers, at least as wide as size_t so they are checked against max_size() before narrowing
+        typedef typename std::common_type<size_type, std::size_t>::type count_type;
         public:
-
-#if ((defined __cplusplus) && (__cplusplus >= 202002L)) 
-        typedef std::allocator_traits<AllocatorT>::template rebind_traits<value_info> allocator_traits;
-        typedef std::allocator_traits<AllocatorT>::template rebind_alloc<value_info> allocator_type;
-#else
-        typedef typename AllocatorT::rebind<value_info>::other allocator_type;
-        typedef std::allocator_traits<allocator_type> allocator_traits;
-#endif
+        typedef FreeListT<size_type, container_type> free_list_type;
+        typedef GrowthT growth_type;
 
         private:
+        // Values live in a dense array of raw storage, occupancy lives in bitmap_,
+        // so a slot costs sizeof(T) plus one bit instead of a padded {T, bool} pair.
         typename allocator_traits::pointer data_;
+        bitmap_type bitmap_;
         size_type size_;
         size_type capacity_;
+        size_type liveCount_;
         allocator_type allocator_;
-        container_type freeIndeces_;
+        free_list_type freeIndeces_;
+#if (defined SPARSE_VECTOR_ENABLE_STATS)
+        sparse_vector_stats stats_;
+        sparse_vector_allocation_hook allocationHook_ = nullptr;
+        void* allocationContext_ = nullptr;
+
+        void note_allocation(size_type oldCapacity) {
+            if (allocationHook_ == nullptr)
+                return;
+            sparse_vector_allocation_event event;
+            event.oldCapacity = oldCapacity;
+            event.newCapacity = capacity_;
+            event.bytes = static_cast<std::uint64_t>(capacity_) * sizeof(value_type) + (static_cast<std::uint64_t>(capacity_) + details::word_bits - 1) / details::word_bits * sizeof(details::bitmap_word);
+            allocationHook_(allocationContext_, event);
+        }
+        void note_size(size_type size) noexcept {
+            if (size > stats_.peakSize)
+                stats_.peakSize = size;
+        }
+#endif
 
         private:
         
@@ -107,70 +1211,353 @@ namespace sv {
             Если хранилище под указателем можно расширить - оно будет расширено и вернётся true, нет? - вернёт false.
 
             Тогда жизнь стала бы значительно быстрее(+0.5% прозводительности).
+
+            Allocators that provide reallocate(p, oldCapacity, newCapacity) (see malloc_allocator) get exactly that
+            for trivially relocatable values.
         */
+        typedef std::integral_constant<bool, is_trivially_relocatable<value_type>::value> relocatable_tag;
+        typedef std::integral_constant<bool, details::has_reallocate<allocator_type>::value> reallocatable_tag;
+        typedef std::integral_constant<bool, std::is_trivially_copyable<value_type>::value> copyable_tag;
+        typedef std::integral_constant<bool, std::is_trivially_destructible<value_type>::value> destructible_tag;
+        typedef std::integral_constant<bool, details::has_touch<bitmap_type>::value> tracking_tag;
+
+        void touch(size_type i, std::true_type) noexcept {
+            bitmap_.touch(i);
+        }
+        void touch(size_type, std::false_type) noexcept {
+        }
+
+        // whole block goes to the allocator, which may not even copy it
+        typename allocator_traits::pointer grow_data(size_type newCapacity, std::true_type, std::true_type) {
+            return allocator_.reallocate(data_, capacity_, newCapacity);
+        }
+        // one memcpy of the slots below size_, holes (and links stored in them) included,
+        // links of holes cut off by pop_back sit at size_ and above and are carried by transfer
+        typename allocator_traits::pointer grow_data(size_type newCapacity, std::true_type, std::false_type) {
+            typename allocator_traits::pointer newData = allocator_.allocate(newCapacity);
+            if (size_ != 0)
+                std::memcpy(static_cast<void*>(&newData[0]), static_cast<const void*>(&data_[0]), size_ * sizeof(value_type));
+            freeIndeces_.transfer(newData, data_);
+            if (data_ != nullptr)
+                allocator_.deallocate(data_, capacity_);
+            return newData;
+        }
+        // moves when that can't throw and copies otherwise, the old values are destroyed once all of them are in place,
+        // so a throw leaves data_ as it was
+        template<class ReallocatableTag>
+        typename allocator_traits::pointer grow_data(size_type newCapacity, std::false_type, ReallocatableTag) {
+            typename allocator_traits::pointer newData = allocator_.allocate(newCapacity);
+            size_type i = bitmap_.find_next(0, size_);
+            try {
+                for (; i < size_; i = bitmap_.find_next(i + 1, size_))
+                    new(&newData[i])value_type(std::move_if_noexcept(data_[i]));
+            } catch (...) {
+                for (size_type k = bitmap_.find_next(0, i); k < i; k = bitmap_.find_next(k + 1, i))
+                    newData[k].~value_type();
+                allocator_.deallocate(newData, newCapacity);
+                throw;
+            }
+            freeIndeces_.transfer(newData, data_);
+            destroy_live();
+            if (data_ != nullptr)
+                allocator_.deallocate(data_, capacity_);
+            return newData;
+        }
 
         // changes data and capacity
-        // newCapacity MUST BE more than current capacity
+        // newCapacity MUST NOT be less than size_
         void reallocate(size_type newCapacity) { 
-            typename allocator_traits::pointer newData = allocator_.allocate(newCapacity);
-            for (size_type i = 0; i < size_; ++i) {
-                if (!data_[i].exist) {
-                    newData[i].exist = false;
-                } else {
-                    details::move_place<value_type>(newData[i].value, data_[i].value);
-                    newData[i].exist = true;
-                }
+            word_allocator_type wordAllocator(allocator_);
+            bitmap_.reallocate(wordAllocator, capacity_, newCapacity);
+            try {
+                data_ = grow_data(newCapacity, relocatable_tag(), reallocatable_tag());
+            } catch (...) {
+                bitmap_.reallocate(wordAllocator, newCapacity, capacity_);
+                throw;
             }
-            allocator_.deallocate(data_, capacity_);
-            data_ = newData;
+            SPARSE_VECTOR_STAT(const size_type oldCapacity = capacity_;)
             capacity_ = newCapacity;
+            SPARSE_VECTOR_STAT(++stats_.reallocations; stats_.bytesMoved += static_cast<std::uint64_t>(size_) * sizeof(value_type); note_allocation(oldCapacity);)
         }
         void mark_as_free(size_type i) {
-            freeIndeces_.push_back(i);
-            data_[i].exist = false;
+            bitmap_.reset(i);
+            freeIndeces_.push(data_, i);
+            SPARSE_VECTOR_STAT(if (freeIndeces_.size() > stats_.freeListPeak) stats_.freeListPeak = freeIndeces_.size();)
         }
-
-        public:
-        sparse_vector() : data_(nullptr), size_(0), capacity_(2), allocator_(), freeIndeces_() {
-            data_ = allocator_.allocate(capacity_); // bad allocation check provided by allocator_type, maybe
+        // clamped to max_size(), an index type that is full gives no more than that
+        [[nodiscard]] size_type next_capacity() const noexcept {
+            const std::uint64_t grown = growth_type::next_capacity(capacity_, sizeof(value_type));
+            return grown > max_size() ? max_size() : static_cast<size_type>(grown);
+        }
+        void check_count(count_type count, const char* message) const {
+            if (count > max_size())
+                throw std::length_error(message);
+        }
+        template<class IndexT>
+        [[nodiscard]] static bool negative(IndexT index, std::true_type /* signed */) noexcept {
+            return index < IndexT(0);
+        }
+        template<class IndexT>
+        [[nodiscard]] static bool negative(IndexT, std::false_type) noexcept {
+            return false;
+        }
+        // index of a caller range as size_type, one that does not fit is never a valid index and throws instead of being cut
+        template<class IndexT>
+        [[nodiscard]] static size_type checked_index(IndexT index, const char* message) {
+            typedef typename std::make_unsigned<typename std::common_type<IndexT, size_type>::type>::type wide_type;
+            if (negative(index, std::is_signed<IndexT>()) || static_cast<wide_type>(index) >= static_cast<wide_type>(max_size()))
+                throw std::out_of_range(message);
+            return static_cast<size_type>(index);
+        }
+        // a hole or size_ for a new slot at the tail, slot storage is raw, construct_claimed takes it
+        size_type claim_index() {
+            while (!freeIndeces_.empty()) {
+                const size_type index = freeIndeces_.pop(data_, bitmap_, size_);
+                if (index < size_) { // bigger ones were cut off by pop_back or compact_step
+                    SPARSE_VECTOR_STAT(++stats_.holeReuses;)
+                    return index;
+                }
+            }
+            if (size_ >= capacity_) {
+                if (size_ == max_size())
+                    throw std::length_error("sparse_vector index type is full. push_free.");
+                reallocate(next_capacity());
+            }
+            SPARSE_VECTOR_STAT(++stats_.tailAppends; note_size(size_ + 1);)
+            return size_;
+        }
+        void destroy_live() noexcept {
+            destroy_live(destructible_tag());
+        }
+        // nothing to run for trivially destructible T, clear and the destructor skip the walk
+        void destroy_live(std::true_type) noexcept {
         }
-        sparse_vector(allocator_type allocator) : data_(nullptr), size_(0), capacity_(2), allocator_(allocator), freeIndeces_() {
+        void destroy_live(std::false_type) noexcept {
+            for (size_type i = bitmap_.find_next(0, size_); i < size_; i = bitmap_.find_next(i + 1, size_))
+                data_[i].~value_type();
+        }
+        // one growth for extra more slots at the tail
+        void grow_for(size_type extra) {
+            if (extra > max_size() - size_)
+                throw std::length_error("sparse_vector index type is full. push_free_n.");
+            const size_type needed = size_ + extra;
+            if (needed <= capacity_)
+                return;
+            reallocate(needed > next_capacity() ? needed : next_capacity());
+        }
+        // builds a value in a hole or at size_, a throw lists the hole again, the tail just stays where it was
+        template<class ConstructFn>
+        void construct_claimed(size_type index, ConstructFn construct) {
+            try {
+                construct(&data_[index]);
+            } catch (...) {
+                if (index != size_)
+                    freeIndeces_.push(data_, index);
+                throw;
+            }
+            bitmap_.set(index);
+            ++liveCount_;
+            if (index == size_)
+                ++size_;
+        }
+        // n inserts, holes are consumed first, the rest is constructed sequentially into the tail
+        template<class ConstructFn, class OutputIt>
+        OutputIt emplace_n(size_type n, ConstructFn construct, OutputIt indices) {
+            const size_type holes = size_ - liveCount_;
+            if (n > holes)
+                grow_for(n - holes);
+            while (n != 0 && !freeIndeces_.empty()) {
+                const size_type index = freeIndeces_.pop(data_, bitmap_, size_);
+                if (index >= size_)
+                    continue;
+                construct_claimed(index, construct);
+                SPARSE_VECTOR_STAT(++stats_.holeReuses;)
+                *indices++ = index;
+                --n;
+            }
+            for (; n != 0; --n) {
+                const size_type index = size_;
+                construct_claimed(index, construct);
+                SPARSE_VECTOR_STAT(++stats_.tailAppends;)
+                *indices++ = index;
+            }
+            SPARSE_VECTOR_STAT(note_size(size_);)
+            return indices;
+        }
+        template<class InputIt, class OutputIt>
+        OutputIt emplace_range(InputIt first, InputIt last, OutputIt indices, std::input_iterator_tag) {
+            for (; first != last; ++first)
+                *indices++ = emplace_free(*first);
+            return indices;
+        }
+        template<class ForwardIt, class OutputIt>
+        OutputIt emplace_range(ForwardIt first, ForwardIt last, OutputIt indices, std::forward_iterator_tag) {
+            const count_type count = static_cast<count_type>(std::distance(first, last));
+            check_count(count, "sparse_vector index type is full. emplace_range.");
+            const size_type n = static_cast<size_type>(count);
+            return emplace_n(n, [&first](pointer p) { new(p)value_type(*first); ++first; }, indices);
+        }
+        // moves value from live slot src to hole dst
+        void relocate(size_type src, size_type dst) {
+            details::move_place<value_type>(data_[dst], data_[src]);
+            if (std::is_move_constructible<value_type>::value)
+                data_[src].~value_type();
+            bitmap_.reset(src);
+            bitmap_.set(dst);
+        }
+        // free list must hold exactly the holes below size_
+        void prune_free_list() {
+            if (freeIndeces_.size() != size_ - liveCount_)
+                freeIndeces_.prune(data_, size_, size_ - liveCount_);
+        }
+        // live values of other into raw storage of the same size, one memcpy for trivially copyable T
+        // values are moved out of other when it is not const, free list links are left to transfer
+        template<class OtherT>
+        void copy_values(OtherT& other, std::true_type) noexcept {
+            if (size_ != 0)
+                std::memcpy(static_cast<void*>(&data_[0]), static_cast<const void*>(&other.data_[0]), size_ * sizeof(value_type));
+        }
+        template<class OtherT>
+        void copy_values(OtherT& other, std::false_type) {
+            typedef typename std::conditional<std::is_const<OtherT>::value, const value_type&, value_type&&>::type source_type;
+            size_type i = other.bitmap_.find_next(0, size_);
+            try {
+                for (; i < size_; i = other.bitmap_.find_next(i + 1, size_))
+                    new(&data_[i])value_type(static_cast<source_type>(other.data_[i]));
+            } catch (...) {
+                for (size_type k = other.bitmap_.find_next(0, i); k < i; k = other.bitmap_.find_next(k + 1, i))
+                    data_[k].~value_type();
+                throw;
+            }
+        }
+        void allocate_storage() {
+            if (capacity_ == 0)
+                return;
             data_ = allocator_.allocate(capacity_); // bad allocation check provided by allocator_type, maybe
+            word_allocator_type wordAllocator(allocator_);
+            try {
+                bitmap_.allocate(wordAllocator, capacity_);
+            } catch (...) {
+                allocator_.deallocate(data_, capacity_);
+                data_ = nullptr;
+                throw;
+            }
         }
-        sparse_vector(const sparse_vector& other) : size_(other.size_), capacity_(other.capacity_), allocator_(other.allocator_), freeIndeces_(other.freeIndeces_) {
-            data_ = allocator_.allocate(capacity_);
-            for (size_type i = 0; i < size_; ++i) {
-                value_info& cell = data_[i];
-                value_info& otherCell = other.data_[i];
 
-                if (!otherCell.exist) {
-                    cell.exist = false;
-                } else {
-                    new(&cell.value)value_type(otherCell.value);
-                    cell.exist = true;
-                }
+        // own storage of other's capacity, sizes and free list are already taken
+        template<class OtherT>
+        void clone_storage(OtherT& other) {
+            if (capacity_ == 0)
+                return;
+            data_ = allocator_.allocate(capacity_);
+            word_allocator_type wordAllocator(allocator_);
+            try {
+                bitmap_.copy_from(wordAllocator, other.bitmap_, capacity_);
+            } catch (...) {
+                allocator_.deallocate(data_, capacity_);
+                throw;
             }
+            try {
+                copy_values(other, copyable_tag());
+            } catch (...) {
+                bitmap_.deallocate(wordAllocator, capacity_);
+                allocator_.deallocate(data_, capacity_);
+                throw;
+            }
+            freeIndeces_.transfer(data_, other.data_); // links of cut off holes lie above size_, copy_values stops there
         }
-        sparse_vector(sparse_vector&& other) : data_(other.data_), size_(other.size_), capacity_(other.capacity_), allocator_(SPARSE_VECTOR_MOVE(other.allocator_)), freeIndeces_(SPARSE_VECTOR_MOVE(other.freeIndeces_)) {
+        void steal_storage(sparse_vector& other) noexcept {
+            data_ = other.data_;
+            bitmap_ = other.bitmap_;
             other.data_ = nullptr;
+            other.bitmap_.release();
             other.size_ = 0;
+            other.capacity_ = 0;
+            other.liveCount_ = 0;
+            other.freeIndeces_.clear();
         }
-        sparse_vector(std::initializer_list<value_type> other) : data_(nullptr), size_(other.size()), capacity_(other.size()), allocator_(), freeIndeces_() {
-            data_ = allocator_.allocate(capacity_);
+        // SwapAllocatorsTag false keeps both allocators, they must be equal
+        void exchange(sparse_vector& other, std::true_type) noexcept {
+            using std::swap;
+            swap(allocator_, other.allocator_);
+            exchange(other, std::false_type());
+        }
+        void exchange(sparse_vector& other, std::false_type) noexcept {
+            using std::swap;
+            swap(data_, other.data_);
+            swap(bitmap_, other.bitmap_);
+            swap(size_, other.size_);
+            swap(capacity_, other.capacity_);
+            swap(liveCount_, other.liveCount_);
+            swap(freeIndeces_, other.freeIndeces_);
+#if (defined SPARSE_VECTOR_ENABLE_STATS)
+            swap(stats_, other.stats_);
+            swap(allocationHook_, other.allocationHook_);
+            swap(allocationContext_, other.allocationContext_);
+#endif
+        }
+
+        public:
+        // storage is allocated by the first insert or reserve
+        sparse_vector() noexcept : data_(nullptr), bitmap_(), size_(0), capacity_(0), liveCount_(0), allocator_(), freeIndeces_(index_allocator_type(allocator_)) {
+        }
+        sparse_vector(allocator_type allocator) noexcept : data_(nullptr), bitmap_(), size_(0), capacity_(0), liveCount_(0), allocator_(allocator), freeIndeces_(index_allocator_type(allocator_)) {
+        }
+        sparse_vector(const sparse_vector& other) : sparse_vector(other, allocator_traits::select_on_container_copy_construction(other.allocator_)) {
+        }
+        sparse_vector(const sparse_vector& other, allocator_type allocator) : data_(nullptr), bitmap_(), size_(other.size_), capacity_(other.capacity_), liveCount_(other.liveCount_), allocator_(allocator), freeIndeces_(other.freeIndeces_, index_allocator_type(allocator_)) {
+            clone_storage(other);
+        }
+        // other is left empty without storage, it may be used again
+        sparse_vector(sparse_vector&& other) noexcept : data_(nullptr), bitmap_(), size_(other.size_), capacity_(other.capacity_), liveCount_(other.liveCount_), allocator_(SPARSE_VECTOR_MOVE(other.allocator_)), freeIndeces_(SPARSE_VECTOR_MOVE(other.freeIndeces_), index_allocator_type(allocator_)) {
+            steal_storage(other);
+        }
+        // takes the storage when allocators are equal, moves value by value into own storage otherwise, other is left empty
+        sparse_vector(sparse_vector&& other, allocator_type allocator) : data_(nullptr), bitmap_(), size_(other.size_), capacity_(other.capacity_), liveCount_(other.liveCount_), allocator_(allocator), freeIndeces_(SPARSE_VECTOR_MOVE(other.freeIndeces_), index_allocator_type(allocator_)) {
+            if (allocator_ == other.allocator_) {
+                steal_storage(other);
+                return;
+            }
+            clone_storage(other);
+            other.clear();
+        }
+        sparse_vector(std::initializer_list<value_type> other) : data_(nullptr), bitmap_(), size_(other.size()), capacity_(other.size()), liveCount_(other.size()), allocator_(), freeIndeces_(index_allocator_type(allocator_)) {
+            allocate_storage();
             for (size_type i = 0; i < size_; ++i) {
-                value_info& cell = data_[i];
-                new(&cell.value)value_type(*(other.begin() + i));
-                cell.exist = true;
+                new(&data_[i])value_type(*(other.begin() + i));
+                bitmap_.set(i);
             }
         }
 
+        public:
+        // allocators follow the propagate_on_container_* traits, pmr allocators stay where they are
+        sparse_vector& operator=(const sparse_vector& other) {
+            if (this != &other) {
+                sparse_vector copy(other, allocator_traits::propagate_on_container_copy_assignment::value ? other.allocator_ : allocator_);
+                exchange(copy, typename allocator_traits::propagate_on_container_copy_assignment());
+            }
+            return *this;
+        }
+        sparse_vector& operator=(sparse_vector&& other) noexcept(allocator_traits::propagate_on_container_move_assignment::value) {
+            if (this != &other) {
+                sparse_vector moved(SPARSE_VECTOR_MOVE(other), allocator_traits::propagate_on_container_move_assignment::value ? other.allocator_ : allocator_);
+                exchange(moved, typename allocator_traits::propagate_on_container_move_assignment());
+            }
+            return *this;
+        }
+        // exchanges storage, O(1), indices and iterators follow their values
+        // allocators are swapped only with propagate_on_container_swap, otherwise they must be equal
+        void swap(sparse_vector& other) noexcept {
+            exchange(other, typename allocator_traits::propagate_on_container_swap());
+        }
+
         public:
         ~sparse_vector() {
             if (data_ == nullptr)
                 return;
-            for (auto& i : (*this)) {
-                i.~value_type();
-            }
+            destroy_live();
+            word_allocator_type wordAllocator(allocator_);
+            bitmap_.deallocate(wordAllocator, capacity_);
             allocator_.deallocate(data_, capacity_);
             data_ = nullptr;
             size_ = 0;
@@ -178,109 +1565,240 @@ namespace sv {
 
         public:
         size_type push_free(const_referens val) {
-            size_type index;
-            if (freeIndeces_.empty()) {
-                if (size_ >= capacity_)
-                    reallocate(capacity_ * 2);
-                index = size_;
-                ++size_;
-            } else {
-                index = freeIndeces_.back();
-                freeIndeces_.pop_back();
-            }
-
-            value_info& cell = data_[index];
-            new(&cell.value)value_type(val);
-            cell.exist = true;
+            const size_type index = claim_index();
+            construct_claimed(index, [&val](pointer p) { new(p)value_type(val); });
             return index;
         }
         template<class... ArgsT>
         size_type emplace_free(ArgsT&&... args) {
-            size_type index;
-            if (freeIndeces_.empty()) {
-                if (size_ >= capacity_)
-                    reallocate(capacity_ * 2);
-                index = size_;
-                ++size_;
-            } else {
-                index = freeIndeces_.back();
-                freeIndeces_.pop_back();
-            }
-
-            value_info& cell = data_[index];
-            new(&cell.value)value_type(std::forward<ArgsT>(args)...);
-            cell.exist = true;
+            const size_type index = claim_index();
+            construct_claimed(index, [&](pointer p) { new(p)value_type(std::forward<ArgsT>(args)...); });
             return index;
         }
+        // n copies of val, writes their indices to indices
+        template<class OutputIt>
+        OutputIt push_free_n(count_type n, const_referens val, OutputIt indices) {
+            check_count(n, "sparse_vector index type is full. push_free_n.");
+            return emplace_n(static_cast<size_type>(n), [&val](pointer p) { new(p)value_type(val); }, indices);
+        }
+        // value constructed from every element of [first, last), writes their indices to indices.
+        // Forward ranges grow storage at most once.
+        template<class InputIt, class OutputIt>
+        OutputIt emplace_range(InputIt first, InputIt last, OutputIt indices) {
+            return emplace_range(first, last, indices, typename std::iterator_traits<InputIt>::iterator_category());
+        }
         void erase_at(size_type index) {
-            if (index > size_)
+            if (index >= size_)
                 throw std::out_of_range("out of sparse_vector range on erase_at.");
-            value_info& cell = data_[index];
-            if (!cell.exist)
+            if (!bitmap_.test(index))
                 throw std::out_of_range("value doesnt exist in sparse_vector on this index. erase_at.");
-            cell.value.~value_type();
+            data_[index].~value_type();
             mark_as_free(index);
+            --liveCount_;
+            SPARSE_VECTOR_STAT(++stats_.erases;)
+        }
+        // erase_at for every index of [first, last)
+        template<class InputIt>
+        void erase_batch(InputIt first, InputIt last) {
+            for (; first != last; ++first) {
+                const size_type index = checked_index(*first, "out of sparse_vector range on erase_batch.");
+                if (index >= size_)
+                    throw std::out_of_range("out of sparse_vector range on erase_batch.");
+                if (!bitmap_.test(index))
+                    throw std::out_of_range("value doesnt exist in sparse_vector on this index. erase_batch.");
+                data_[index].~value_type();
+                mark_as_free(index);
+                --liveCount_;
+                SPARSE_VECTOR_STAT(++stats_.erases;)
+            }
         }
         void pop_back() {
             if (size_ == 0)
                 throw std::out_of_range("sparse_vector is empty on pop_back.");
             --size_;
-            value_info& cell = data_[size_]; // Это НЕЛЬЗЯ ложить в контейнер свободных индексов, ведь размер был изменён
-            cell.value.~value_type();
-            cell.exist = false;
+            // Это НЕЛЬЗЯ ложить в контейнер свободных индексов, ведь размер был изменён
+            if (bitmap_.test(size_)) {
+                data_[size_].~value_type();
+                bitmap_.reset(size_);
+                --liveCount_;
+                SPARSE_VECTOR_STAT(++stats_.erases;)
+            }
         }
         template<class FunctT>
         void feel_free_cells(FunctT funct) {
-            for (size_type i = 0; i < size_; ++i) {
-                value_info& cell = data_[i];
-                if (!cell.exist) {
-                    new(&cell.value)value_type(funct());
-                    cell.exist = true;
-                }
+            for (size_type i = bitmap_.find_next_zero(0, size_); i < size_; i = bitmap_.find_next_zero(i + 1, size_)) {
+                new(&data_[i])value_type(funct());
+                bitmap_.set(i);
+                ++liveCount_;
             }
             freeIndeces_.clear(); // Все значения были заняты, так что свободных индексов больше не существует
         }
-        void reserve(size_type newCapacity) {
+        void reserve(count_type newCapacity) {
             if (capacity_ >= newCapacity)
                 return;
-            reallocate(newCapacity);
+            check_count(newCapacity, "sparse_vector index type is full. reserve.");
+            reallocate(static_cast<size_type>(newCapacity));
         }
         // resize with free cells
-        void resize(size_type newSize) {
+        // shrinking destroys values at newSize and above
+        void resize(count_type count) {
+            check_count(count, "sparse_vector index type is full. resize.");
+            const size_type newSize = static_cast<size_type>(count);
+            if (newSize < size_) {
+                for (size_type i = bitmap_.find_next(newSize, size_); i < size_; i = bitmap_.find_next(i + 1, size_)) {
+                    data_[i].~value_type();
+                    bitmap_.reset(i);
+                    --liveCount_;
+                    SPARSE_VECTOR_STAT(++stats_.erases;)
+                }
+                size_ = newSize;
+                prune_free_list();
+                return;
+            }
             reserve(newSize);
+            prune_free_list();
             for (size_type i = size_; i < newSize; ++i) {
                 mark_as_free(i);
             }
             size_ = newSize;
+            SPARSE_VECTOR_STAT(note_size(size_);)
         }
         [[nodiscard]] bool exist_at(size_type i) const noexcept {
             if (size_ <= i)
                 return false;
-            value_info& cell = data_[i];
-            if (!cell.exist)
-                return false;
-            return true;
+            return bitmap_.test(i);
         }
         template<class... ArgsT>
         void emplace_at(size_type i, ArgsT&&... args) {
             if (size_ <= i)
                 throw std::out_of_range("index out of sparse_vector size on emplace_at.");
-            value_info& cell = data_[i];
-            if (cell.exist)
+            if (bitmap_.test(i))
                 throw std::out_of_range("value already exist in sparse_vector on this index. emplace_at.");
-            new(&cell.value)value_type(std::forward<ArgsT>(args)...);
-            cell.exist = true;
+            freeIndeces_.remove(data_, i); // an intrusive link must not stay under the new value
+            try {
+                new(&data_[i])value_type(std::forward<ArgsT>(args)...);
+            } catch (...) {
+                freeIndeces_.push(data_, i);
+                throw;
+            }
+            bitmap_.set(i);
+            ++liveCount_;
         }
-        void clear() {
-            for (size_type i = 0; i < size_; ++i) {
-                value_info& cell = data_[i];
-                if (cell.exist) { // Сдесь НЕ нужно пополнять freeIndeces_, даже наоборот
-                    cell.value.~value_type();
-                    cell.exist = false;
+        // Rebuilds from saved slots, used by load of sparse_vector_io.hpp.
+        // Bit i of words marks a live slot, construct(pointer, i) makes its value in place.
+        // Holes are pushed in [holesFirst, holesLast) order when that is exactly the set of holes, in index order otherwise.
+        // A listed hole that does not fit size_type throws std::out_of_range and leaves the vector as it was.
+        template<class HoleIt, class ConstructFn>
+        void restore(size_type size, const details::bitmap_word* words, HoleIt holesFirst, HoleIt holesLast, ConstructFn construct) {
+            for (HoleIt it = holesFirst; it != holesLast; ++it) // every cast below is exact after this
+                static_cast<void>(checked_index(*it, "hole out of sparse_vector range on restore."));
+            clear();
+            reserve(size);
+            for (size_type i = 0; i < size; ++i) {
+                if (!((words[i / details::word_bits] >> (i % details::word_bits)) & 1u))
+                    continue;
+                try {
+                    construct(&data_[i], i);
+                } catch (...) {
+                    size_ = i;
+                    clear();
+                    throw;
+                }
+                bitmap_.set(i);
+                ++liveCount_;
+                size_ = i + 1;
+            }
+            size_ = size;
+            SPARSE_VECTOR_STAT(note_size(size_);)
+            // a listed hole is marked live for a moment, so a repeated or live index shows up
+            size_type pushed = 0;
+            bool exact = true;
+            for (HoleIt it = holesFirst; it != holesLast; ++it) {
+                const size_type hole = static_cast<size_type>(*it);
+                if (hole >= size_ || bitmap_.test(hole)) {
+                    exact = false;
+                    break;
                 }
+                bitmap_.set(hole);
+                ++pushed;
+            }
+            for (HoleIt it = holesFirst; pushed != 0; ++it, --pushed)
+                bitmap_.reset(static_cast<size_type>(*it));
+            if (exact && static_cast<size_type>(std::distance(holesFirst, holesLast)) == size_ - liveCount_) {
+                for (HoleIt it = holesFirst; it != holesLast; ++it)
+                    freeIndeces_.push(data_, static_cast<size_type>(*it));
+            } else {
+                for (size_type i = bitmap_.find_next_zero(0, size_); i < size_; i = bitmap_.find_next_zero(i + 1, size_))
+                    freeIndeces_.push(data_, i);
+            }
+        }
+        // Moves values from the back into the holes until there are none, then size() == live_count().
+        // remap(oldIndex, newIndex) is called for every moved value.
+        template<class RemapFn>
+        void compact(RemapFn remap) {
+            const size_type target = liveCount_;
+            size_type hole = bitmap_.find_next_zero(0, target);
+            for (size_type src = bitmap_.find_next(target, size_); src < size_; src = bitmap_.find_next(src + 1, size_)) {
+                relocate(src, hole);
+                remap(src, hole);
+                hole = bitmap_.find_next_zero(hole + 1, target);
             }
             freeIndeces_.clear();
+            size_ = target;
+        }
+        // Same as compact, but moves at most maxMoves values per call. Other calls may run in between.
+        // Returns true when no holes are left.
+        template<class RemapFn>
+        bool compact_step(size_type maxMoves, RemapFn remap) {
+            size_ = bitmap_.trailing_end(size_);
+            for (size_type moves = 0; moves < maxMoves && size_ != liveCount_;) {
+                const size_type hole = freeIndeces_.pop(data_, bitmap_, size_);
+                if (hole >= size_)
+                    continue;
+                relocate(size_ - 1, hole);
+                remap(size_ - 1, hole);
+                size_ = bitmap_.trailing_end(size_ - 1);
+                ++moves;
+            }
+            if (size_ != liveCount_)
+                return false;
+            freeIndeces_.clear();
+            return true;
+        }
+        // lowers size() to one past the last live value and drops the cut off holes from the free list
+        void trim_trailing_holes() {
+            size_ = bitmap_.trailing_end(size_);
+            prune_free_list();
+        }
+        // trim_trailing_holes, then gives back capacity above size(), all of it when nothing is left
+        void shrink_to_fit() {
+            trim_trailing_holes();
+            shrink_to(size_);
+        }
+        // gives back capacity above max(newCapacity, size()), holes stay, the ones cut off by pop_back leave the free list
+        void shrink_to(size_type newCapacity) {
+            if (newCapacity < size_)
+                newCapacity = size_;
+            if (newCapacity == 0 && data_ != nullptr) {
+                word_allocator_type wordAllocator(allocator_);
+                bitmap_.deallocate(wordAllocator, capacity_);
+                allocator_.deallocate(data_, capacity_);
+                data_ = nullptr;
+                capacity_ = 0;
+                freeIndeces_.clear();
+                return;
+            }
+            if (capacity_ > newCapacity) {
+                prune_free_list(); // cut off holes may lie above newCapacity
+                reallocate(newCapacity);
+            }
+        }
+        void clear() {
+            destroy_live(); // Сдесь НЕ нужно пополнять freeIndeces_, даже наоборот
+            bitmap_.reset_all(size_);
+            freeIndeces_.clear();
             size_ = 0;
+            liveCount_ = 0;
         }
         [[nodiscard]] size_type size() const noexcept {
             return size_;
@@ -288,35 +1806,115 @@ namespace sv {
         [[nodiscard]] size_type capacity() const noexcept {
             return capacity_;
         }
+        // biggest size, the top value of size_type stays free as npos of the free lists
+        [[nodiscard]] static constexpr size_type max_size() noexcept {
+            return static_cast<size_type>(static_cast<size_type>(-1) - 1);
+        }
+        // number of existing values, size() counts holes too
+        [[nodiscard]] size_type live_count() const noexcept {
+            return liveCount_;
+        }
+        [[nodiscard]] allocator_type get_allocator() const noexcept {
+            return allocator_;
+        }
+        // stack_free_list only
         [[nodiscard]] const container_type& get_free_cells() const noexcept {
-            return freeIndeces_;
+            return freeIndeces_.container();
+        }
+        [[nodiscard]] size_type free_count() const noexcept {
+            return size_ - liveCount_;
+        }
+        // fn(index) for every hole, in the order push_free reuses them
+        template<class IndexFn>
+        void for_each_free(IndexFn fn) const {
+            const size_type size = size_;
+            freeIndeces_.for_each(data_, bitmap_, size_, [&fn, size](size_type i) {
+                if (i < size) // cut off by pop_back
+                    fn(i);
+            });
+        }
+        // change tracking, needs a change_tracking_bitmap BitmapT (touch does nothing without one)
+        // writes through iterators, data() or the simd helpers are not seen, touch those slots by hand
+        void touch(size_type i) noexcept {
+            touch(i, tracking_tag());
+        }
+        // fn(index) for every slot below size() changed since clear_dirty, live or hole, in index order
+        // slots cut off by pop_back, resize or clear are not visited (clear marks its slots dirty, but they end up above size()),
+        // so a replica first cuts itself to size() and then applies the dirty slots
+        template<class IndexFn>
+        void for_each_dirty(IndexFn fn) const {
+            for (size_type i = bitmap_.find_next_dirty(0, size_); i < size_; i = bitmap_.find_next_dirty(i + 1, size_))
+                fn(i);
+        }
+        void clear_dirty() noexcept {
+            bitmap_.clear_dirty(capacity_);
+        }
+        [[nodiscard]] const bitmap_type& get_bitmap() const noexcept {
+            return bitmap_;
+        }
+        // counters need SPARSE_VECTOR_ENABLE_STATS, size, liveCount and holeRatio are always filled
+        [[nodiscard]] sparse_vector_stats stats() const noexcept {
+#if (defined SPARSE_VECTOR_ENABLE_STATS)
+            sparse_vector_stats result = stats_;
+#else
+            sparse_vector_stats result;
+#endif
+            result.size = size_;
+            result.liveCount = liveCount_;
+            result.holeRatio = size_ == 0 ? 0.0 : static_cast<double>(size_ - liveCount_) / static_cast<double>(size_);
+            return result;
+        }
+#if (defined SPARSE_VECTOR_ENABLE_STATS)
+        void reset_stats() noexcept {
+            stats_ = sparse_vector_stats();
+        }
+        // hook(context, event) is called after every reallocation, nullptr turns it off
+        void set_allocation_hook(sparse_vector_allocation_hook hook, void* context) noexcept {
+            allocationHook_ = hook;
+            allocationContext_ = context;
+        }
+#endif
+        // slot storage, holes are not constructed values, check get_bitmap() before touching them
+        [[nodiscard]] pointer data() noexcept {
+            return data_;
+        }
+        [[nodiscard]] const_pointer data() const noexcept {
+            return data_;
         }
 
         public:
         [[nodiscard]] referens operator[](size_type i) {
-            return data_[i].value;
+            touch(i, tracking_tag());
+            return data_[i];
         }
         [[nodiscard]] const_referens operator[](size_type i) const {
-            return data_[i].value;
+            return data_[i];
         }
         [[nodiscard]] referens at(size_type i) {
             if (size_ <= i)
                 throw std::out_of_range("index out of sparse_vector size on at.");
-            value_info& cell = data_[i];
-            if (!cell.exist)
+            if (!bitmap_.test(i))
                 throw std::out_of_range("value doesnt exist in sparse_vector on this index. at.");
-            return data_[i].value;
+            touch(i, tracking_tag());
+            return data_[i];
         }
         [[nodiscard]] const_referens at(size_type i) const {
             if (size_ <= i)
                 throw std::out_of_range("index out of sparse_vector size on at.");
-            value_info& cell = data_[i];
-            if (!cell.exist)
+            if (!bitmap_.test(i))
                 throw std::out_of_range("value doesnt exist in sparse_vector on this index. at.");
-            return data_[i].value;
+            return data_[i];
         }
 
         public:
+        /*
+            Iterators keep the live bits of their current 64 slot word, ++ goes back to the bitmap once per word.
+            Reallocation (growth, reserve, shrink_to), assignment and everything that changes size() other than growth
+            (pop_back, resize, trim_trailing_holes, compact, clear) invalidate them, swap keeps them with their values.
+            Erasing the value an iterator points at, or any value behind it, keeps the iterator valid.
+            Inserts and erases ahead of it are seen only past its current word: within that word an erased slot
+            is still visited and a filled hole is skipped, so erase ahead of an iterator only after it moved on.
+        */
         struct iterator {
             public:
             typedef T value_type;
@@ -324,48 +1922,76 @@ namespace sv {
             typedef const T& const_referens;
             typedef T* pointer;
             typedef const T* const_pointer;
+            typedef T& reference;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
 
             private:
-            value_info* ptr_;
-            const value_info* endPtr_; // yeah, weird
+            friend class sparse_vector;
+            pointer data_;
+            const bitmap_type* bitmap_;
+            size_type index_;
+            size_type end_;
+            details::bitmap_word rest_; // live bits of current word above index_ and below end_
+
+            void seek(size_type i) noexcept {
+                index_ = bitmap_->find_next(i, end_);
+                if (index_ >= end_)
+                    return;
+                const size_type word = index_ / details::word_bits;
+                rest_ = bitmap_->words()[word] & ((~details::bitmap_word(0) << (index_ % details::word_bits)) << 1);
+                if (word == (end_ - 1) / details::word_bits)
+                    rest_ &= details::mask_through(static_cast<unsigned>((end_ - 1) % details::word_bits));
+            }
 
             public:
-            iterator(value_info* ptr, const value_info* endPtr) noexcept : ptr_(ptr), endPtr_(endPtr) {
-                while ((ptr_ != endPtr_) && !ptr_->exist) {
-                    ++ptr_;
-                }
+            iterator() noexcept : data_(nullptr), bitmap_(nullptr), index_(0), end_(0), rest_(0) {
+            }
+            iterator(pointer data, const bitmap_type* bitmap, size_type index, size_type end) noexcept : data_(data), bitmap_(bitmap), index_(index), end_(end), rest_(0) {
+                seek(index);
             }
 
             public:
             [[nodiscard]] pointer operator->() noexcept {
-                return &ptr_->value;
+                return &data_[index_];
             }
             [[nodiscard]] const_pointer operator->() const noexcept {
-                return &ptr_->value;
+                return &data_[index_];
             }
             [[nodiscard]] referens operator*() noexcept {
-                return ptr_->value;
+                return data_[index_];
             }
             [[nodiscard]] const_referens operator*() const noexcept {
-                return ptr_->value;
+                return data_[index_];
             }
             
 
             public:
             iterator& operator++() noexcept {
-                ++ptr_;
-                while ((ptr_ != endPtr_) && !ptr_->exist) {
-                    ++ptr_;
+                if (rest_ == 0) {
+                    const size_type lastInWord = index_ | size_type(details::word_bits - 1);
+                    if (lastInWord >= end_ - 1) // next word start may not fit in a narrow size_type
+                        index_ = end_;
+                    else
+                        seek(lastInWord + 1);
+                } else {
+                    index_ = (index_ & ~size_type(details::word_bits - 1)) + details::countr_zero(rest_);
+                    rest_ &= rest_ - 1;
                 }
                 return *this;
             }
+            iterator operator++(int) noexcept {
+                iterator old = *this;
+                ++(*this);
+                return old;
+            }
 
             public:
             [[nodiscard]] bool operator==(const iterator& other) const noexcept {
-                return ptr_ == other.ptr_;
+                return index_ == other.index_;
             }
             [[nodiscard]] bool operator!=(const iterator& other) const noexcept {
-                return ptr_ != other.ptr_;
+                return index_ != other.index_;
             }
             
         };
@@ -374,41 +2000,70 @@ namespace sv {
             typedef T value_type;
             typedef const value_type& const_referens;
             typedef const value_type* const_pointer;
+            typedef const value_type* pointer;
+            typedef const value_type& reference;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
             
             private:
-            const value_info* ptr_;
-            const value_info* endPtr_; // yeah, weird
+            friend class sparse_vector;
+            const_pointer data_;
+            const bitmap_type* bitmap_;
+            size_type index_;
+            size_type end_;
+            details::bitmap_word rest_; // live bits of current word above index_ and below end_
+
+            void seek(size_type i) noexcept {
+                index_ = bitmap_->find_next(i, end_);
+                if (index_ >= end_)
+                    return;
+                const size_type word = index_ / details::word_bits;
+                rest_ = bitmap_->words()[word] & ((~details::bitmap_word(0) << (index_ % details::word_bits)) << 1);
+                if (word == (end_ - 1) / details::word_bits)
+                    rest_ &= details::mask_through(static_cast<unsigned>((end_ - 1) % details::word_bits));
+            }
             
             public:
-            const_iterator(const value_info* ptr, const value_info* endPtr) : ptr_(ptr), endPtr_(endPtr) {
-                while ((ptr_ != endPtr_) && !ptr_->exist) {
-                    ++ptr_;
-                }
+            const_iterator() noexcept : data_(nullptr), bitmap_(nullptr), index_(0), end_(0), rest_(0) {
+            }
+            const_iterator(const_pointer data, const bitmap_type* bitmap, size_type index, size_type end) noexcept : data_(data), bitmap_(bitmap), index_(index), end_(end), rest_(0) {
+                seek(index);
             }
 
             public:
             [[nodiscard]] const_pointer operator->() const noexcept {
-                return &ptr_->value;
+                return &data_[index_];
             }
             [[nodiscard]] const_referens operator*() const noexcept {
-                return ptr_->value;
+                return data_[index_];
             }
 
             public:
             const_iterator& operator++() noexcept {
-                ++ptr_;
-                while ((ptr_ != endPtr_) && !ptr_->exist) {
-                    ++ptr_;
+                if (rest_ == 0) {
+                    const size_type lastInWord = index_ | size_type(details::word_bits - 1);
+                    if (lastInWord >= end_ - 1) // next word start may not fit in a narrow size_type
+                        index_ = end_;
+                    else
+                        seek(lastInWord + 1);
+                } else {
+                    index_ = (index_ & ~size_type(details::word_bits - 1)) + details::countr_zero(rest_);
+                    rest_ &= rest_ - 1;
                 }
                 return *this;
             }
+            const_iterator operator++(int) noexcept {
+                const_iterator old = *this;
+                ++(*this);
+                return old;
+            }
 
             public:
             [[nodiscard]] bool operator==(const const_iterator& other) const noexcept {
-                return ptr_ == other.ptr_;
+                return index_ == other.index_;
             }
             [[nodiscard]] bool operator!=(const const_iterator& other) const noexcept {
-                return ptr_ != other.ptr_;
+                return index_ != other.index_;
             }
             
         };
@@ -416,23 +2071,133 @@ namespace sv {
 
         public:
         [[nodiscard]] iterator begin() noexcept {
-            return iterator(&data_[0], &data_[size_]);
+            return iterator(&data_[0], &bitmap_, 0, size_);
         }
         [[nodiscard]] iterator end() noexcept {
-            return iterator(&data_[size_], &data_[size_]);
+            return iterator(&data_[0], &bitmap_, size_, size_);
         }
         [[nodiscard]] const_iterator begin() const noexcept {
-            return const_iterator(&data_[0], &data_[size_]);
+            return const_iterator(&data_[0], &bitmap_, 0, size_);
         }
         [[nodiscard]] const_iterator end() const noexcept {
-            return const_iterator(&data_[size_], &data_[size_]);
+            return const_iterator(&data_[0], &bitmap_, size_, size_);
+        }
+        // iterators over live values of [first, last), last <= size()
+        [[nodiscard]] iterator begin_at(size_type first, size_type last) noexcept {
+            return iterator(&data_[0], &bitmap_, first, last);
+        }
+        [[nodiscard]] iterator end_at(size_type last) noexcept {
+            return iterator(&data_[0], &bitmap_, last, last);
+        }
+        [[nodiscard]] const_iterator begin_at(size_type first, size_type last) const noexcept {
+            return const_iterator(&data_[0], &bitmap_, first, last);
+        }
+        [[nodiscard]] const_iterator end_at(size_type last) const noexcept {
+            return const_iterator(&data_[0], &bitmap_, last, last);
+        }
+        // first existing index >= i or size()
+        [[nodiscard]] size_type find_next_live(size_type i) const noexcept {
+            return bitmap_.find_next(i, size_);
         }
         [[nodiscard]] size_type index_of(const iterator& i) const noexcept {
-            return static_cast<size_type>(static_cast<ptrdiff_t>(i.ptr_ - data_));
+            return i.index_;
         }
         [[nodiscard]] size_type index_of(const const_iterator& i) const noexcept {
-            return static_cast<size_type>(static_cast<ptrdiff_t>(i.ptr_ - data_));
+            return i.index_;
+        }
+    };
+
+    template <class T, class AllocatorT, template <class...> class ContainerT, template <class> class BitmapT, template <class, class> class FreeListT, class GrowthT, class SizeT>
+    void swap(sparse_vector<T, AllocatorT, ContainerT, BitmapT, FreeListT, GrowthT, SizeT>& a, sparse_vector<T, AllocatorT, ContainerT, BitmapT, FreeListT, GrowthT, SizeT>& b) noexcept {
+        a.swap(b);
+    }
+
+    // sparse_vector with its own index type, std::uint32_t or std::uint16_t halve the free list and every stored index:
+    //     sv::narrow_sparse_vector<particle, std::uint32_t> particles;
+    template <  class T,
+                class SizeT,
+                class AllocatorT = std::allocator<T>,
+                template <class> class BitmapT = flat_bitmap,
+                template <class, class> class FreeListT = stack_free_list>
+    using narrow_sparse_vector = sparse_vector<T, AllocatorT, SPARSE_VECTOR_DEFAULT_CONTAINER, BitmapT, FreeListT, doubling_growth, SizeT>;
+
+    /*
+        Splittable slot index range over a sparse_vector (or const sparse_vector), models the TBB Range concept:
+            tbb::parallel_for(sv::live_range<V>(v), [](const sv::live_range<V>& r) { for (auto& x : r) ...; });
+        Splits happen on bitmap word boundaries, so two ranges never share a word.
+        first()/last() give plain slot indices for OpenMP style loops.
+    */
+    template <class VectorT>
+    class live_range {
+        public:
+        typedef typename VectorT::size_type size_type;
+        typedef decltype(std::declval<VectorT&>().begin()) iterator;
+
+        private:
+        VectorT* vector_;
+        size_type first_;
+        size_type last_;
+        size_type grain_;
+
+        public:
+        // grain is rounded up to keep at least two words per side of a split
+        explicit live_range(VectorT& v, size_type grain = 4096) noexcept : vector_(&v), first_(0), last_(v.size()), grain_(grain < 2 * details::word_bits ? 2 * details::word_bits : grain) {
+        }
+        live_range(VectorT& v, size_type first, size_type last, size_type grain = 4096) noexcept : vector_(&v), first_(first), last_(last), grain_(grain < 2 * details::word_bits ? 2 * details::word_bits : grain) {
+        }
+        // splitting constructor, takes the upper half from other (SplitT is tbb::split)
+        template<class SplitT>
+        live_range(live_range& other, SplitT) noexcept : vector_(other.vector_), first_(other.split_point()), last_(other.last_), grain_(other.grain_) {
+            other.last_ = first_;
+        }
+
+        public:
+        [[nodiscard]] bool empty() const noexcept {
+            return first_ >= last_;
+        }
+        [[nodiscard]] bool is_divisible() const noexcept {
+            return last_ - first_ > grain_;
+        }
+        [[nodiscard]] size_type first() const noexcept {
+            return first_;
+        }
+        [[nodiscard]] size_type last() const noexcept {
+            return last_;
+        }
+        [[nodiscard]] size_type grainsize() const noexcept {
+            return grain_;
+        }
+        [[nodiscard]] iterator begin() const noexcept {
+            return vector_->begin_at(first_, last_);
+        }
+        [[nodiscard]] iterator end() const noexcept {
+            return vector_->end_at(last_);
+        }
+
+        private:
+        // word aligned middle, first_ is word aligned unless set by hand
+        [[nodiscard]] size_type split_point() const noexcept {
+            const size_type half = ((last_ - first_) / 2) & ~size_type(details::word_bits - 1);
+            return first_ + (half == 0 ? details::word_bits : half);
         }
     };
 };
+
+#if (defined __cplusplus) && (__cplusplus >= 201703L) && (defined __has_include)
+#   if __has_include(<memory_resource>)
+#       include <memory_resource>
+namespace sv {
+    namespace pmr {
+        // sparse_vector on a std::pmr::memory_resource, values, occupancy and free indices all come from it:
+        //     std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+        //     sv::pmr::sparse_vector<int> v(&arena);
+        template <  class T,
+                    template <class> class BitmapT = flat_bitmap,
+                    template <class, class> class FreeListT = stack_free_list,
+                    class GrowthT = doubling_growth>
+        using sparse_vector = sv::sparse_vector<T, std::pmr::polymorphic_allocator<T>, SPARSE_VECTOR_DEFAULT_CONTAINER, BitmapT, FreeListT, GrowthT>;
+    };
+};
+#   endif
+#endif
 #endif
@@ -0,0 +1,140 @@
+/*  sparse_vector_huge_pages.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef SPARSE_VECTOR_HUGE_PAGES_HPP_
+#define SPARSE_VECTOR_HUGE_PAGES_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+#if (defined __linux__)
+#   include <sys/mman.h>
+#   define SPARSE_VECTOR_HAS_HUGE_PAGES 1
+#endif
+
+namespace sv {
+    /*
+        Allocator for big tables, blocks of at least Threshold bytes are mapped straight from the kernel
+        and rounded up to whole huge pages: MAP_HUGETLB first (needs reserved pages in vm.nr_hugepages),
+        then a huge page aligned anonymous mapping with madvise(MADV_HUGEPAGE) for transparent huge pages.
+        Smaller blocks, and every block where huge pages do not exist, come from malloc.
+        Pair it with page_rounded_growth so capacity fills the mapped pages:
+            sv::sparse_vector<T, sv::huge_page_allocator<T>, std::vector, sv::flat_bitmap, sv::stack_free_list, sv::page_rounded_growth<>>
+    */
+    template <class T, std::size_t Threshold = std::size_t(2) << 20, std::size_t PageBytes = std::size_t(2) << 20>
+    struct huge_page_allocator {
+        typedef T value_type;
+        template<class U>
+        struct rebind {
+            typedef huge_page_allocator<U, Threshold, PageBytes> other;
+        };
+
+        static_assert(PageBytes != 0 && (PageBytes & (PageBytes - 1)) == 0, "huge_page_allocator needs a power of 2 page.");
+        static_assert(Threshold >= PageBytes, "huge_page_allocator threshold must be at least one page.");
+
+        huge_page_allocator() noexcept {
+        }
+        template<class U>
+        huge_page_allocator(const huge_page_allocator<U, Threshold, PageBytes>&) noexcept {
+        }
+
+        private:
+        [[nodiscard]] static std::size_t mapped_bytes(std::size_t n) noexcept {
+            return (n * sizeof(T) + PageBytes - 1) & ~(PageBytes - 1);
+        }
+        [[nodiscard]] static bool is_mapped(std::size_t n) noexcept {
+#if (defined SPARSE_VECTOR_HAS_HUGE_PAGES)
+            return n * sizeof(T) >= Threshold;
+#else
+            return (void)n, false;
+#endif
+        }
+#if (defined SPARSE_VECTOR_HAS_HUGE_PAGES)
+        // over-maps by one page and cuts both ends, so the block starts on a huge page boundary
+        [[nodiscard]] static void* map_aligned(std::size_t bytes) noexcept {
+            void* raw = ::mmap(nullptr, bytes + PageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED)
+                return nullptr;
+            const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(raw);
+            const std::uintptr_t aligned = (begin + PageBytes - 1) & ~(static_cast<std::uintptr_t>(PageBytes) - 1);
+            if (aligned != begin)
+                ::munmap(raw, aligned - begin);
+            if (aligned + bytes != begin + bytes + PageBytes)
+                ::munmap(reinterpret_cast<void*>(aligned + bytes), begin + PageBytes - aligned);
+#   if (defined MADV_HUGEPAGE)
+            ::madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#   endif
+            return reinterpret_cast<void*>(aligned);
+        }
+        [[nodiscard]] static void* map(std::size_t bytes) noexcept {
+#   if (defined MAP_HUGETLB)
+            if (PageBytes == (std::size_t(2) << 20)) {
+                void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (p != MAP_FAILED)
+                    return p;
+            }
+#   endif
+            return map_aligned(bytes);
+        }
+#endif
+
+        public:
+        [[nodiscard]] T* allocate(std::size_t n) {
+            static_assert(alignof(T) <= alignof(std::max_align_t), "huge_page_allocator cant provide this alignment.");
+            void* p = nullptr;
+#if (defined SPARSE_VECTOR_HAS_HUGE_PAGES)
+            if (is_mapped(n))
+                p = map(mapped_bytes(n));
+            else
+#endif
+                p = std::malloc(n * sizeof(T));
+            if (p == nullptr && n != 0)
+                throw std::bad_alloc();
+            return static_cast<T*>(p);
+        }
+        void deallocate(T* p, std::size_t n) noexcept {
+#if (defined SPARSE_VECTOR_HAS_HUGE_PAGES)
+            if (is_mapped(n)) {
+                ::munmap(static_cast<void*>(p), mapped_bytes(n));
+                return;
+            }
+#endif
+            std::free(p);
+        }
+        // capacity that fills the pages a block of n values is mapped on, n when it would come from malloc
+        [[nodiscard]] static std::size_t usable_size(std::size_t n) noexcept {
+            return is_mapped(n) ? mapped_bytes(n) / sizeof(T) : n;
+        }
+
+        template<class U>
+        [[nodiscard]] bool operator==(const huge_page_allocator<U, Threshold, PageBytes>&) const noexcept {
+            return true;
+        }
+        template<class U>
+        [[nodiscard]] bool operator!=(const huge_page_allocator<U, Threshold, PageBytes>&) const noexcept {
+            return false;
+        }
+    };
+};
+#endif
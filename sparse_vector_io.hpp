@@ -0,0 +1,504 @@
+/*  sparse_vector_io.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef SPARSE_VECTOR_IO_HPP_
+#define SPARSE_VECTOR_IO_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+#include <cstdio>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#if (defined __unix__) || (defined __APPLE__)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define SPARSE_VECTOR_HAS_MMAP 1
+#endif
+
+/*
+    On-disk format, host byte order, every field is 64 bit aligned:
+
+        offset 0    header, 64 bytes
+                        char     magic[8]    "SPVECTOR"
+                        uint32   version     1, reads as another number on a host of other byte order
+                        uint32   flags       bit 0 set: values are raw bytes, clear: values are streamed
+                        uint64   value_size  sizeof(T)
+                        uint64   value_align alignof(T)
+                        uint64   size        slots, holes included
+                        uint64   live_count
+                        uint64   free_count  holes
+                        uint64   reserved    0
+        64          occupancy, (size + 63) / 64 uint64 words, bit i of word i / 64 is set while slot i is live
+                    free list, free_count uint64 indices, pushed in this order, so the last one is reused first,
+                    save writes them from the vector's free list and load pushes them back in the same order
+                    zero padding to a multiple of 64
+        values      raw: size * value_size bytes, holes are zero bytes
+                    streamed: live values in index order, as written by the write function
+
+    Raw format needs trivially copyable T and is what sparse_vector_view maps.
+*/
+
+namespace sv {
+    namespace details {
+        static const char io_magic[8] = { 'S', 'P', 'V', 'E', 'C', 'T', 'O', 'R' };
+        static const std::uint32_t io_version = 1;
+        static const std::uint32_t io_raw = 1;
+
+        struct io_header {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t flags;
+            std::uint64_t valueSize;
+            std::uint64_t valueAlign;
+            std::uint64_t size;
+            std::uint64_t liveCount;
+            std::uint64_t freeCount;
+            std::uint64_t reserved;
+        };
+        static_assert(sizeof(io_header) == 64, "io_header must be 64 bytes.");
+
+        [[nodiscard]] inline std::uint64_t io_words(std::uint64_t size) noexcept {
+            return (size + word_bits - 1) / word_bits;
+        }
+        // offset of the values, right after the padded occupancy and free list
+        [[nodiscard]] inline std::uint64_t io_values_offset(const io_header& header) noexcept {
+            const std::uint64_t end = sizeof(io_header) + (io_words(header.size) + header.freeCount) * sizeof(std::uint64_t);
+            return (end + 63) / 64 * 64;
+        }
+        inline void io_check(const io_header& header, std::uint64_t valueSize, std::uint64_t valueAlign) {
+            if (std::memcmp(header.magic, io_magic, sizeof(io_magic)) != 0)
+                throw std::runtime_error("not a sparse_vector file.");
+            if (header.version != io_version)
+                throw std::runtime_error("sparse_vector file of other version or byte order.");
+            if (header.valueSize != valueSize || header.valueAlign != valueAlign)
+                throw std::runtime_error("sparse_vector file holds values of other type.");
+            if (header.liveCount + header.freeCount != header.size)
+                throw std::runtime_error("sparse_vector file is damaged.");
+        }
+
+        struct file_sink {
+            std::FILE* file;
+            void write(const void* bytes, std::size_t count) {
+                if (count != 0 && std::fwrite(bytes, 1, count, file) != count)
+                    throw std::runtime_error("cant write sparse_vector file.");
+            }
+        };
+        struct stream_sink {
+            std::ostream* stream;
+            void write(const void* bytes, std::size_t count) {
+                if (!stream->write(static_cast<const char*>(bytes), static_cast<std::streamsize>(count)))
+                    throw std::runtime_error("cant write sparse_vector stream.");
+            }
+        };
+        struct file_source {
+            std::FILE* file;
+            void read(void* bytes, std::size_t count) {
+                if (count != 0 && std::fread(bytes, 1, count, file) != count)
+                    throw std::runtime_error("cant read sparse_vector file.");
+            }
+        };
+        struct stream_source {
+            std::istream* stream;
+            void read(void* bytes, std::size_t count) {
+                if (!stream->read(static_cast<char*>(bytes), static_cast<std::streamsize>(count)))
+                    throw std::runtime_error("cant read sparse_vector stream.");
+            }
+        };
+
+        // header, occupancy, free list and padding
+        template<class VectorT, class SinkT>
+        void save_head(SinkT& sink, const VectorT& v, std::uint32_t flags) {
+            typedef typename VectorT::value_type value_type;
+            io_header header;
+            std::memcpy(header.magic, io_magic, sizeof(io_magic));
+            header.version = io_version;
+            header.flags = flags;
+            header.valueSize = sizeof(value_type);
+            header.valueAlign = alignof(value_type);
+            header.size = v.size();
+            header.liveCount = v.live_count();
+            header.freeCount = v.size() - v.live_count();
+            header.reserved = 0;
+            sink.write(&header, sizeof(header));
+            const std::uint64_t wordCount = io_words(header.size);
+            const bitmap_word* words = v.get_bitmap().words();
+            for (std::uint64_t w = 0; w < wordCount; ++w) {
+                const std::uint64_t word = words[w];
+                sink.write(&word, sizeof(word));
+            }
+            // for_each_free gives reuse order, the file keeps push order
+            std::vector<std::uint64_t> holes;
+            holes.reserve(static_cast<std::size_t>(header.freeCount));
+            v.for_each_free([&holes](typename VectorT::size_type i) { holes.push_back(i); });
+            if (holes.size() != header.freeCount) { // a list that does not hold every hole, index order is what load rebuilds then
+                holes.clear();
+                for (std::uint64_t i = v.get_bitmap().find_next_zero(0, v.size()); i < header.size; i = v.get_bitmap().find_next_zero(i + 1, v.size()))
+                    holes.push_back(i);
+            } else {
+                std::reverse(holes.begin(), holes.end());
+            }
+            sink.write(holes.data(), holes.size() * sizeof(std::uint64_t));
+            static const char zeros[64] = {};
+            const std::uint64_t written = sizeof(io_header) + (wordCount + header.freeCount) * sizeof(std::uint64_t);
+            sink.write(zeros, static_cast<std::size_t>(io_values_offset(header) - written));
+        }
+        template<class VectorT, class SinkT>
+        void save_raw(SinkT& sink, const VectorT& v) {
+            typedef typename VectorT::value_type value_type;
+            static_assert(std::is_trivially_copyable<value_type>::value, "raw sparse_vector files need trivially copyable T, pass a write function.");
+            save_head(sink, v, io_raw);
+            const bitmap_word* words = v.get_bitmap().words();
+            const value_type* data = v.data();
+            std::vector<unsigned char> buffer(word_bits * sizeof(value_type));
+            for (std::uint64_t first = 0; first < v.size(); first += word_bits) {
+                const std::size_t count = static_cast<std::size_t>(v.size() - first < word_bits ? v.size() - first : word_bits);
+                const bitmap_word bits = words[first / word_bits];
+                if (bits == ~bitmap_word(0)) {
+                    sink.write(data + first, count * sizeof(value_type));
+                    continue;
+                }
+                std::memset(buffer.data(), 0, count * sizeof(value_type));
+                for (bitmap_word rest = bits; rest != 0; rest &= rest - 1) {
+                    const unsigned k = countr_zero(rest);
+                    std::memcpy(buffer.data() + k * sizeof(value_type), static_cast<const void*>(data + first + k), sizeof(value_type));
+                }
+                sink.write(buffer.data(), count * sizeof(value_type));
+            }
+        }
+        // reads header, occupancy and free list, stops at the first value byte
+        template<class SourceT>
+        void load_head(SourceT& source, io_header& header, std::vector<std::uint64_t>& words, std::vector<std::uint64_t>& holes, std::uint64_t valueSize, std::uint64_t valueAlign) {
+            source.read(&header, sizeof(header));
+            io_check(header, valueSize, valueAlign);
+            words.resize(static_cast<std::size_t>(io_words(header.size)));
+            holes.resize(static_cast<std::size_t>(header.freeCount));
+            source.read(words.data(), words.size() * sizeof(std::uint64_t));
+            source.read(holes.data(), holes.size() * sizeof(std::uint64_t));
+            char padding[64];
+            const std::uint64_t read = sizeof(io_header) + (words.size() + holes.size()) * sizeof(std::uint64_t);
+            source.read(padding, static_cast<std::size_t>(io_values_offset(header) - read));
+        }
+        template<class VectorT, class SourceT, class ConstructFn>
+        void load_into(SourceT& source, VectorT& v, std::uint32_t flags, ConstructFn construct) {
+            typedef typename VectorT::value_type value_type;
+            io_header header;
+            std::vector<std::uint64_t> words;
+            std::vector<std::uint64_t> holes;
+            load_head(source, header, words, holes, sizeof(value_type), alignof(value_type));
+            if ((header.flags & io_raw) != flags)
+                throw std::runtime_error(flags ? "sparse_vector file holds streamed values, pass a read function." : "sparse_vector file holds raw values, load without a read function.");
+            if (header.size > static_cast<std::uint64_t>(VectorT::max_size()))
+                throw std::length_error("sparse_vector file is bigger than size_type.");
+            construct.start(header.size);
+            v.restore(static_cast<typename VectorT::size_type>(header.size), words.data(), holes.begin(), holes.end(), construct);
+            construct.finish(header.size);
+        }
+
+        // raw values arrive in index order, the first live value reads [0, size) straight into the storage with one read,
+        // restore pushes the free list only after every value is in, so the hole bytes read over it are dropped
+        template<class SourceT, class T>
+        struct raw_construct {
+            SourceT* source;
+            std::uint64_t* position;
+            std::uint64_t size;
+            void start(std::uint64_t valueCount) noexcept {
+                size = valueCount;
+            }
+            void skip_to(std::uint64_t i) {
+                unsigned char holes[4096];
+                for (std::uint64_t bytes = (i - *position) * sizeof(T); bytes != 0; ) {
+                    const std::size_t count = static_cast<std::size_t>(bytes < sizeof(holes) ? bytes : sizeof(holes));
+                    source->read(holes, count);
+                    bytes -= count;
+                }
+                *position = i;
+            }
+            void operator()(T* where, std::uint64_t i) {
+                if (i < *position)
+                    return;
+                T* const first = where - static_cast<std::size_t>(i - *position);
+                source->read(static_cast<void*>(first), static_cast<std::size_t>((size - *position) * sizeof(T)));
+                *position = size;
+            }
+            // trailing holes, so the source ends right after this vector
+            void finish(std::uint64_t size) {
+                skip_to(size);
+            }
+        };
+        template<class T, class ReadFn>
+        struct stream_construct {
+            std::istream* stream;
+            ReadFn* read;
+            void start(std::uint64_t) noexcept {
+            }
+            void operator()(T* where, std::uint64_t) {
+                new(where)T((*read)(*stream));
+            }
+            void finish(std::uint64_t) noexcept {
+            }
+        };
+    };
+
+    // raw format, T must be trivially copyable
+    template<class VectorT>
+    void save(std::FILE* file, const VectorT& v) {
+        details::file_sink sink = { file };
+        details::save_raw(sink, v);
+    }
+    template<class VectorT>
+    void save(std::ostream& stream, const VectorT& v) {
+        details::stream_sink sink = { &stream };
+        details::save_raw(sink, v);
+    }
+    // streamed format for any T, write(stream, value) is called for live values in index order
+    template<class VectorT, class WriteFn>
+    void save(std::ostream& stream, const VectorT& v, WriteFn write) {
+        details::stream_sink sink = { &stream };
+        details::save_head(sink, v, 0);
+        for (typename VectorT::const_iterator it = v.begin(); it != v.end(); ++it)
+            write(stream, *it);
+        if (!stream)
+            throw std::runtime_error("cant write sparse_vector stream.");
+    }
+
+    // replaces contents of v with a raw file, every value keeps its index
+    template<class VectorT>
+    void load(std::FILE* file, VectorT& v) {
+        typedef typename VectorT::value_type value_type;
+        static_assert(std::is_trivially_copyable<value_type>::value, "raw sparse_vector files need trivially copyable T, pass a read function.");
+        details::file_source source = { file };
+        std::uint64_t position = 0;
+        details::raw_construct<details::file_source, value_type> construct = { &source, &position, 0 };
+        details::load_into(source, v, details::io_raw, construct);
+    }
+    template<class VectorT>
+    void load(std::istream& stream, VectorT& v) {
+        typedef typename VectorT::value_type value_type;
+        static_assert(std::is_trivially_copyable<value_type>::value, "raw sparse_vector files need trivially copyable T, pass a read function.");
+        details::stream_source source = { &stream };
+        std::uint64_t position = 0;
+        details::raw_construct<details::stream_source, value_type> construct = { &source, &position, 0 };
+        details::load_into(source, v, details::io_raw, construct);
+    }
+    // streamed format, read(stream) returns the next live value
+    template<class VectorT, class ReadFn>
+    void load(std::istream& stream, VectorT& v, ReadFn read) {
+        typedef typename VectorT::value_type value_type;
+        details::stream_source source = { &stream };
+        details::stream_construct<value_type, ReadFn> construct = { &stream, &read };
+        details::load_into(source, v, 0, construct);
+    }
+
+    /*
+        Read only sparse_vector over bytes of a raw file, usually a mapping of it, nothing is copied or parsed past the header.
+        exist_at, at and iteration read the occupancy and values in place, the OS faults pages in as they are touched.
+        Bytes must stay valid and 64 byte aligned while the view is used (mmap gives page alignment).
+    */
+    template <class T>
+    class sparse_vector_view {
+        public:
+        typedef T value_type;
+        typedef const T& const_referens;
+        typedef const T* const_pointer;
+        typedef SPARSE_VECTOR_SIZE_TYPE size_type;
+
+        static_assert(std::is_trivially_copyable<T>::value, "sparse_vector_view needs trivially copyable T.");
+        static_assert(alignof(T) <= 64, "sparse_vector_view cant align values past 64 bytes.");
+
+        private:
+        const details::bitmap_word* words_;
+        const_pointer data_;
+        size_type size_;
+        size_type liveCount_;
+
+        public:
+        sparse_vector_view() noexcept : words_(nullptr), data_(nullptr), size_(0), liveCount_(0) {
+        }
+        sparse_vector_view(const void* bytes, std::size_t length) : words_(nullptr), data_(nullptr), size_(0), liveCount_(0) {
+            if (length < sizeof(details::io_header))
+                throw std::runtime_error("sparse_vector file is too short.");
+            if (reinterpret_cast<std::uintptr_t>(bytes) % 64 != 0)
+                throw std::runtime_error("sparse_vector_view needs 64 byte aligned bytes.");
+            details::io_header header;
+            std::memcpy(&header, bytes, sizeof(header));
+            details::io_check(header, sizeof(T), alignof(T));
+            if (!(header.flags & details::io_raw))
+                throw std::runtime_error("sparse_vector_view cant map streamed values.");
+            const std::uint64_t valuesOffset = details::io_values_offset(header);
+            if (valuesOffset > length || (length - valuesOffset) / sizeof(T) < header.size)
+                throw std::runtime_error("sparse_vector file is too short.");
+            const unsigned char* base = static_cast<const unsigned char*>(bytes);
+            words_ = reinterpret_cast<const details::bitmap_word*>(base + sizeof(details::io_header));
+            data_ = reinterpret_cast<const_pointer>(base + valuesOffset);
+            size_ = static_cast<size_type>(header.size);
+            liveCount_ = static_cast<size_type>(header.liveCount);
+        }
+
+        public:
+        [[nodiscard]] bool exist_at(size_type i) const noexcept {
+            if (size_ <= i)
+                return false;
+            return (words_[i / details::word_bits] >> (i % details::word_bits)) & 1u;
+        }
+        [[nodiscard]] const_referens operator[](size_type i) const noexcept {
+            return data_[i];
+        }
+        [[nodiscard]] const_referens at(size_type i) const {
+            if (size_ <= i)
+                throw std::out_of_range("index out of sparse_vector_view size on at.");
+            if (!exist_at(i))
+                throw std::out_of_range("value doesnt exist in sparse_vector_view on this index. at.");
+            return data_[i];
+        }
+        [[nodiscard]] size_type size() const noexcept {
+            return size_;
+        }
+        [[nodiscard]] size_type live_count() const noexcept {
+            return liveCount_;
+        }
+        [[nodiscard]] size_type free_count() const noexcept {
+            return size_ - liveCount_;
+        }
+        [[nodiscard]] const details::bitmap_word* words() const noexcept {
+            return words_;
+        }
+        [[nodiscard]] const_pointer data() const noexcept {
+            return data_;
+        }
+
+        public:
+        struct const_iterator {
+            public:
+            typedef T value_type;
+            typedef const value_type* pointer;
+            typedef const value_type& reference;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
+
+            private:
+            const sparse_vector_view* view_;
+            size_type index_;
+
+            void seek(size_type i) noexcept {
+                index_ = details::scan_words<size_type>(view_->words_, i, view_->size_, 0);
+            }
+
+            public:
+            const_iterator() noexcept : view_(nullptr), index_(0) {
+            }
+            const_iterator(const sparse_vector_view* view, size_type index) noexcept : view_(view), index_(index) {
+                seek(index);
+            }
+
+            public:
+            [[nodiscard]] pointer operator->() const noexcept {
+                return &view_->data_[index_];
+            }
+            [[nodiscard]] reference operator*() const noexcept {
+                return view_->data_[index_];
+            }
+            [[nodiscard]] size_type index() const noexcept {
+                return index_;
+            }
+            const_iterator& operator++() noexcept {
+                seek(index_ + 1);
+                return *this;
+            }
+            const_iterator operator++(int) noexcept {
+                const_iterator old = *this;
+                ++(*this);
+                return old;
+            }
+            [[nodiscard]] bool operator==(const const_iterator& other) const noexcept {
+                return index_ == other.index_;
+            }
+            [[nodiscard]] bool operator!=(const const_iterator& other) const noexcept {
+                return index_ != other.index_;
+            }
+        };
+        [[nodiscard]] const_iterator begin() const noexcept {
+            return const_iterator(this, 0);
+        }
+        [[nodiscard]] const_iterator end() const noexcept {
+            return const_iterator(this, size_);
+        }
+    };
+
+#if (defined SPARSE_VECTOR_HAS_MMAP)
+    // read only private mapping of a whole file, view<T>() serves it as sparse_vector_view
+    class mapped_sparse_file {
+        private:
+        void* bytes_;
+        std::size_t length_;
+
+        public:
+        explicit mapped_sparse_file(const char* path) : bytes_(nullptr), length_(0) {
+            const int fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cant open sparse_vector file.");
+            struct stat info;
+            if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+                ::close(fd);
+                throw std::runtime_error("cant map sparse_vector file.");
+            }
+            length_ = static_cast<std::size_t>(info.st_size);
+            void* bytes = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd); // mapping keeps the file
+            if (bytes == MAP_FAILED)
+                throw std::runtime_error("cant map sparse_vector file.");
+            bytes_ = bytes;
+        }
+        mapped_sparse_file(const mapped_sparse_file&) = delete;
+        mapped_sparse_file& operator=(const mapped_sparse_file&) = delete;
+        mapped_sparse_file(mapped_sparse_file&& other) noexcept : bytes_(other.bytes_), length_(other.length_) {
+            other.bytes_ = nullptr;
+            other.length_ = 0;
+        }
+
+        public:
+        ~mapped_sparse_file() {
+            if (bytes_ != nullptr)
+                ::munmap(bytes_, length_);
+        }
+
+        public:
+        template<class T>
+        [[nodiscard]] sparse_vector_view<T> view() const {
+            return sparse_vector_view<T>(bytes_, length_);
+        }
+        [[nodiscard]] const void* bytes() const noexcept {
+            return bytes_;
+        }
+        [[nodiscard]] std::size_t length() const noexcept {
+            return length_;
+        }
+    };
+#endif
+};
+#endif
@@ -0,0 +1,127 @@
+/*  sparse_vector_parallel.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef SPARSE_VECTOR_PARALLEL_HPP_
+#define SPARSE_VECTOR_PARALLEL_HPP_ 1
+
+#if !((defined __cplusplus) && (__cplusplus >= 201703L))
+#   error "sparse_vector_parallel.hpp needs C++17."
+#endif
+
+#include "sparse_vector.hpp"
+
+#include <execution>
+#include <numeric>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+/*
+    Parallel algorithms over live values of sparse_vector.
+
+    [0, size()) is cut into chunks of whole bitmap words (chunkWords * 64 slots, 4096 by default, 0 is taken as 1),
+    so workers never share a word and chunks full of holes cost only their word loads.
+    Chunks are many more than threads, the scheduler balances uneven ones (TBB backed std::execution::par steals work).
+
+    policy is a standard execution policy or an executor, any object with
+        void parallel_for(std::size_t count, F f) - calls f(i) for every i in [0, count) and returns when all are done.
+*/
+
+namespace sv {
+    namespace details {
+        static const std::size_t default_chunk_words = 64;
+
+        template<class ExecutorT>
+        struct is_std_policy : std::is_execution_policy<typename std::decay<ExecutorT>::type> {
+        };
+
+        template<class ExecutorT, class FunctT>
+        void parallel_chunks(ExecutorT&& executor, std::size_t count, FunctT funct) {
+            if constexpr (is_std_policy<ExecutorT>::value) {
+                std::vector<std::size_t> chunks(count);
+                std::iota(chunks.begin(), chunks.end(), std::size_t(0));
+                std::for_each(std::forward<ExecutorT>(executor), chunks.begin(), chunks.end(), funct);
+            } else {
+                executor.parallel_for(count, funct);
+            }
+        }
+
+        // calls funct(index, value) for every live slot of words [firstWord, lastWord)
+        template<class VectorT, class FunctT>
+        void for_each_live_words(VectorT& v, std::size_t firstWord, std::size_t lastWord, FunctT& funct) {
+            const bitmap_word* words = v.get_bitmap().words();
+            for (std::size_t w = firstWord; w < lastWord; ++w) {
+                bitmap_word bits = words[w];
+                while (bits != 0) {
+                    const typename VectorT::size_type i = static_cast<typename VectorT::size_type>(w * word_bits + countr_zero(bits));
+                    funct(i, v[i]);
+                    bits &= bits - 1;
+                }
+            }
+        }
+    };
+
+    // funct(index, value&) for every live value, calls may run concurrently
+    template<class ExecutorT, class VectorT, class FunctT>
+    void for_each_live(ExecutorT&& policy, VectorT& v, FunctT funct, std::size_t chunkWords = details::default_chunk_words) {
+        if (chunkWords == 0)
+            chunkWords = 1;
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        const std::size_t chunkCount = (wordCount + chunkWords - 1) / chunkWords;
+        details::parallel_chunks(std::forward<ExecutorT>(policy), chunkCount, [&v, &funct, wordCount, chunkWords](std::size_t chunk) {
+            const std::size_t first = chunk * chunkWords;
+            const std::size_t last = first + chunkWords < wordCount ? first + chunkWords : wordCount;
+            details::for_each_live_words(v, first, last, funct);
+        });
+    }
+
+    // reduce(init, transform(index, value)...) over live values, reduce must be associative and commutative
+    template<class ExecutorT, class VectorT, class ResultT, class ReduceT, class TransformT>
+    ResultT transform_reduce_live(ExecutorT&& policy, const VectorT& v, ResultT init, ReduceT reduce, TransformT transform, std::size_t chunkWords = details::default_chunk_words) {
+        if (chunkWords == 0)
+            chunkWords = 1;
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        const std::size_t chunkCount = (wordCount + chunkWords - 1) / chunkWords;
+        std::vector<std::optional<ResultT>> partials(chunkCount); // chunk without values has no result, there is no identity to give it
+        details::parallel_chunks(std::forward<ExecutorT>(policy), chunkCount, [&](std::size_t chunk) {
+            const std::size_t first = chunk * chunkWords;
+            const std::size_t last = first + chunkWords < wordCount ? first + chunkWords : wordCount;
+            std::optional<ResultT>& partial = partials[chunk];
+            auto accumulate = [&](typename VectorT::size_type i, const typename VectorT::value_type& value) {
+                if (partial)
+                    *partial = reduce(SPARSE_VECTOR_MOVE(*partial), transform(i, value));
+                else
+                    partial.emplace(transform(i, value));
+            };
+            details::for_each_live_words(v, first, last, accumulate);
+        });
+        for (std::optional<ResultT>& partial : partials) {
+            if (partial)
+                init = reduce(SPARSE_VECTOR_MOVE(init), SPARSE_VECTOR_MOVE(*partial));
+        }
+        return init;
+    }
+};
+#endif
@@ -0,0 +1,436 @@
+/*  sparse_vector_simd.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef SPARSE_VECTOR_SIMD_HPP_
+#define SPARSE_VECTOR_SIMD_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+#include <limits>
+
+#if (defined __AVX512F__) && !(defined SPARSE_VECTOR_NO_SIMD)
+#   include <immintrin.h>
+#   define SPARSE_VECTOR_AVX512 1
+#endif
+
+/*
+    Packed export and import of live values, driven by the occupancy words.
+
+    Every bitmap word is one step: a full word copies 64 values in one run, an empty word costs only its load.
+    Mixed words of 4 and 8 byte arithmetic values go through AVX-512 masked load + compress store
+    (masked expand load + masked store for scatter_live), holes and slots past size() are never touched.
+    Without AVX-512 (or with SPARSE_VECTOR_NO_SIMD) mixed words walk their set bits.
+    AVX2 has no compress, a table driven permute would cost more than the bit walk for 64 bit words.
+
+    reduce_live with plus_op, min_op or max_op over arithmetic T reads whole words of values and masks holes out
+    (AVX-512 masked lanes, or a select over 8 independent accumulators the compiler keeps in vector registers),
+    so holes cost no branch. Only words lying fully in capacity() are read whole, the last partial one walks its bits.
+    count_if_live, any_of_live, transform_live and reduce_live with other operations call user code on live values only:
+    full words run a plain loop of 64 values the compiler may vectorize, mixed words walk their set bits.
+    Targets without AVX-512 (NEON included) use the portable loops.
+
+    Works with any sparse_vector bitmap policy.
+*/
+
+namespace sv {
+    namespace details {
+        template<unsigned Lanes>
+        struct simd_lanes_tag : std::integral_constant<unsigned, Lanes> {
+        };
+
+        // lanes per 512 bit register the kernels handle T with, 0 means scalar
+        template<class T>
+        struct simd_lanes : simd_lanes_tag<
+#if (defined SPARSE_VECTOR_AVX512)
+            std::is_arithmetic<T>::value ? (sizeof(T) == 4 ? 16 : (sizeof(T) == 8 ? 8 : 0)) : 0
+#else
+            0
+#endif
+        > {
+        };
+
+        // copies live values of one word to out, returns their count
+        template<class T>
+        std::size_t compress_word(const T* src, bitmap_word bits, T* out, simd_lanes_tag<0>) {
+            std::size_t count = 0;
+            while (bits != 0) {
+                out[count++] = src[countr_zero(bits)];
+                bits &= bits - 1;
+            }
+            return count;
+        }
+        // fills live slots of one word from in, returns how many values were taken
+        template<class T>
+        std::size_t expand_word(T* dst, bitmap_word bits, const T* in, simd_lanes_tag<0>) {
+            std::size_t count = 0;
+            while (bits != 0) {
+                dst[countr_zero(bits)] = in[count++];
+                bits &= bits - 1;
+            }
+            return count;
+        }
+
+#if (defined SPARSE_VECTOR_AVX512)
+        template<class T>
+        std::size_t compress_word(const T* src, bitmap_word bits, T* out, simd_lanes_tag<16>) {
+            T* const first = out;
+            for (unsigned k = 0; k < word_bits && bits != 0; k += 16, bits >>= 16) {
+                const __mmask16 mask = static_cast<__mmask16>(bits);
+                _mm512_mask_compressstoreu_epi32(out, mask, _mm512_maskz_loadu_epi32(mask, src + k));
+                out += _mm_popcnt_u32(mask);
+            }
+            return static_cast<std::size_t>(out - first);
+        }
+        template<class T>
+        std::size_t compress_word(const T* src, bitmap_word bits, T* out, simd_lanes_tag<8>) {
+            T* const first = out;
+            for (unsigned k = 0; k < word_bits && bits != 0; k += 8, bits >>= 8) {
+                const __mmask8 mask = static_cast<__mmask8>(bits);
+                _mm512_mask_compressstoreu_epi64(out, mask, _mm512_maskz_loadu_epi64(mask, src + k));
+                out += _mm_popcnt_u32(mask);
+            }
+            return static_cast<std::size_t>(out - first);
+        }
+        template<class T>
+        std::size_t expand_word(T* dst, bitmap_word bits, const T* in, simd_lanes_tag<16>) {
+            const T* const first = in;
+            for (unsigned k = 0; k < word_bits && bits != 0; k += 16, bits >>= 16) {
+                const __mmask16 mask = static_cast<__mmask16>(bits);
+                _mm512_mask_storeu_epi32(dst + k, mask, _mm512_maskz_expandloadu_epi32(mask, in));
+                in += _mm_popcnt_u32(mask);
+            }
+            return static_cast<std::size_t>(in - first);
+        }
+        template<class T>
+        std::size_t expand_word(T* dst, bitmap_word bits, const T* in, simd_lanes_tag<8>) {
+            const T* const first = in;
+            for (unsigned k = 0; k < word_bits && bits != 0; k += 8, bits >>= 8) {
+                const __mmask8 mask = static_cast<__mmask8>(bits);
+                _mm512_mask_storeu_epi64(dst + k, mask, _mm512_maskz_expandloadu_epi64(mask, in));
+                in += _mm_popcnt_u32(mask);
+            }
+            return static_cast<std::size_t>(in - first);
+        }
+#endif
+
+        template<class VectorT>
+        void check_live(const VectorT& v, typename VectorT::size_type i, const char* message) {
+            if (!v.exist_at(i))
+                throw std::out_of_range(message);
+        }
+    };
+
+    // copies every live value to out in index order, out must hold live_count() values, returns live_count()
+    template<class VectorT>
+    std::size_t gather_live(const VectorT& v, typename VectorT::value_type* out) {
+        typedef typename VectorT::value_type value_type;
+        const details::bitmap_word* words = v.get_bitmap().words();
+        const value_type* data = v.data();
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        value_type* const first = out;
+        for (std::size_t w = 0; w < wordCount; ++w) {
+            const details::bitmap_word bits = words[w];
+            const value_type* src = data + w * details::word_bits;
+            if (bits == ~details::bitmap_word(0))
+                out = std::copy(src, src + details::word_bits, out);
+            else if (bits != 0)
+                out += details::compress_word(src, bits, out, details::simd_lanes<value_type>());
+        }
+        return static_cast<std::size_t>(out - first);
+    }
+    // inverse of gather_live, assigns live values in index order from in, returns live_count()
+    template<class VectorT>
+    std::size_t scatter_live(VectorT& v, const typename VectorT::value_type* in) {
+        typedef typename VectorT::value_type value_type;
+        const details::bitmap_word* words = v.get_bitmap().words();
+        value_type* data = v.data();
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        const value_type* const first = in;
+        for (std::size_t w = 0; w < wordCount; ++w) {
+            const details::bitmap_word bits = words[w];
+            value_type* dst = data + w * details::word_bits;
+            if (bits == ~details::bitmap_word(0)) {
+                std::copy(in, in + details::word_bits, dst);
+                in += details::word_bits;
+            } else if (bits != 0) {
+                in += details::expand_word(dst, bits, in, details::simd_lanes<value_type>());
+            }
+        }
+        return static_cast<std::size_t>(in - first);
+    }
+    // out[k] = v[first[k]], every index must be live
+    template<class VectorT, class IndexIt>
+    void gather(const VectorT& v, IndexIt first, IndexIt last, typename VectorT::value_type* out) {
+        for (; first != last; ++first, ++out) {
+            details::check_live(v, *first, "value doesnt exist in sparse_vector on this index. gather.");
+            *out = v[*first];
+        }
+    }
+    // v[first[k]] = in[k], every index must be live
+    template<class VectorT, class IndexIt>
+    void scatter(VectorT& v, IndexIt first, IndexIt last, const typename VectorT::value_type* in) {
+        for (; first != last; ++first, ++in) {
+            details::check_live(v, *first, "value doesnt exist in sparse_vector on this index. scatter.");
+            v[*first] = *in;
+        }
+    }
+
+    // Reduction operations for reduce_live, identity<T>() is the value that leaves the other operand as is.
+    struct plus_op {
+        template<class T>
+        [[nodiscard]] static T identity() noexcept {
+            return T(0);
+        }
+        template<class T>
+        [[nodiscard]] T operator()(const T& a, const T& b) const {
+            return a + b;
+        }
+    };
+    struct min_op {
+        template<class T>
+        [[nodiscard]] static T identity() noexcept {
+            return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : (std::numeric_limits<T>::max)();
+        }
+        template<class T>
+        [[nodiscard]] T operator()(const T& a, const T& b) const {
+            return b < a ? b : a;
+        }
+    };
+    struct max_op {
+        template<class T>
+        [[nodiscard]] static T identity() noexcept {
+            return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+        }
+        template<class T>
+        [[nodiscard]] T operator()(const T& a, const T& b) const {
+            return a < b ? b : a;
+        }
+    };
+
+    namespace details {
+        // words whose 64 slots all lie in allocated storage may be read as a whole, holes of arithmetic T are just bytes there
+        template<class VectorT>
+        std::size_t whole_words(const VectorT& v) noexcept {
+            return static_cast<std::size_t>(v.capacity()) / word_bits;
+        }
+
+        // only these read holes, as plain bytes of arithmetic T the result never depends on
+        template<class T, class ReduceT>
+        struct has_builtin_reduce : std::integral_constant<bool, std::is_arithmetic<T>::value &&
+            (std::is_same<ReduceT, plus_op>::value || std::is_same<ReduceT, min_op>::value || std::is_same<ReduceT, max_op>::value)> {
+        };
+
+#if (defined SPARSE_VECTOR_AVX512)
+        inline __m512 avx512_load(__mmask16 mask, const float* p) noexcept { return _mm512_maskz_loadu_ps(mask, p); }
+        inline __m512d avx512_load(__mmask8 mask, const double* p) noexcept { return _mm512_maskz_loadu_pd(mask, p); }
+        inline __m512i avx512_load(__mmask16 mask, const std::int32_t* p) noexcept { return _mm512_maskz_loadu_epi32(mask, p); }
+        inline __m512i avx512_load(__mmask8 mask, const std::int64_t* p) noexcept { return _mm512_maskz_loadu_epi64(mask, p); }
+
+        inline __m512 avx512_set1(float x) noexcept { return _mm512_set1_ps(x); }
+        inline __m512d avx512_set1(double x) noexcept { return _mm512_set1_pd(x); }
+        inline __m512i avx512_set1(std::int32_t x) noexcept { return _mm512_set1_epi32(x); }
+        inline __m512i avx512_set1(std::int64_t x) noexcept { return _mm512_set1_epi64(x); }
+
+        // acc lanes outside mask stay as they are
+        inline __m512 avx512_apply(plus_op, float, __m512 acc, __mmask16 mask, __m512 x) noexcept { return _mm512_mask_add_ps(acc, mask, acc, x); }
+        inline __m512 avx512_apply(min_op, float, __m512 acc, __mmask16 mask, __m512 x) noexcept { return _mm512_mask_min_ps(acc, mask, acc, x); }
+        inline __m512 avx512_apply(max_op, float, __m512 acc, __mmask16 mask, __m512 x) noexcept { return _mm512_mask_max_ps(acc, mask, acc, x); }
+        inline __m512d avx512_apply(plus_op, double, __m512d acc, __mmask8 mask, __m512d x) noexcept { return _mm512_mask_add_pd(acc, mask, acc, x); }
+        inline __m512d avx512_apply(min_op, double, __m512d acc, __mmask8 mask, __m512d x) noexcept { return _mm512_mask_min_pd(acc, mask, acc, x); }
+        inline __m512d avx512_apply(max_op, double, __m512d acc, __mmask8 mask, __m512d x) noexcept { return _mm512_mask_max_pd(acc, mask, acc, x); }
+        inline __m512i avx512_apply(plus_op, std::int32_t, __m512i acc, __mmask16 mask, __m512i x) noexcept { return _mm512_mask_add_epi32(acc, mask, acc, x); }
+        inline __m512i avx512_apply(min_op, std::int32_t, __m512i acc, __mmask16 mask, __m512i x) noexcept { return _mm512_mask_min_epi32(acc, mask, acc, x); }
+        inline __m512i avx512_apply(max_op, std::int32_t, __m512i acc, __mmask16 mask, __m512i x) noexcept { return _mm512_mask_max_epi32(acc, mask, acc, x); }
+        inline __m512i avx512_apply(plus_op, std::int64_t, __m512i acc, __mmask8 mask, __m512i x) noexcept { return _mm512_mask_add_epi64(acc, mask, acc, x); }
+        inline __m512i avx512_apply(min_op, std::int64_t, __m512i acc, __mmask8 mask, __m512i x) noexcept { return _mm512_mask_min_epi64(acc, mask, acc, x); }
+        inline __m512i avx512_apply(max_op, std::int64_t, __m512i acc, __mmask8 mask, __m512i x) noexcept { return _mm512_mask_max_epi64(acc, mask, acc, x); }
+
+        // folds lanes one by one, sidesteps _mm512_reduce_* which trip -Wmaybe-uninitialized on GCC 12
+        template<class T, class VecT, class ReduceT>
+        T avx512_fold(ReduceT& reduce, const VecT& acc) {
+            T lanes[sizeof(VecT) / sizeof(T)];
+            std::memcpy(lanes, &acc, sizeof(VecT));
+            T result = lanes[0];
+            for (std::size_t i = 1; i < sizeof(VecT) / sizeof(T); ++i)
+                result = reduce(result, lanes[i]);
+            return result;
+        }
+
+        template<class T, class ReduceT>
+        struct has_avx512_reduce : std::integral_constant<bool, has_builtin_reduce<T, ReduceT>::value &&
+            (std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, std::int32_t>::value || std::is_same<T, std::int64_t>::value)> {
+        };
+
+        template<class T, class ReduceT>
+        T reduce_words(const bitmap_word* words, const T* data, std::size_t wordCount, std::size_t, T init, ReduceT& reduce, std::true_type) {
+            typedef typename std::conditional<sizeof(T) == 4, __mmask16, __mmask8>::type mask_type;
+            const unsigned lanes = 64 / sizeof(T);
+            decltype(avx512_set1(T())) acc = avx512_set1(ReduceT::template identity<T>());
+            for (std::size_t w = 0; w < wordCount; ++w) {
+                bitmap_word bits = words[w];
+                const T* src = data + w * word_bits;
+                for (unsigned k = 0; k < word_bits && bits != 0; k += lanes, bits >>= lanes) {
+                    const mask_type mask = static_cast<mask_type>(bits);
+                    acc = avx512_apply(reduce, T(), acc, mask, avx512_load(mask, src + k));
+                }
+            }
+            return reduce(init, avx512_fold<T>(reduce, acc));
+        }
+#else
+        template<class T, class ReduceT>
+        struct has_avx512_reduce : std::false_type {
+        };
+#endif
+
+        // built-in operation, whole words select identity for holes, 8 chains so no add waits on the one before
+        template<class T, class ReduceT>
+        T reduce_selected(const bitmap_word* words, const T* data, std::size_t wordCount, std::size_t wholeWords, T acc, ReduceT& reduce, std::true_type) {
+            const unsigned chains = 8;
+            const T identity = ReduceT::template identity<T>();
+            T lanes[chains];
+            for (unsigned c = 0; c < chains; ++c)
+                lanes[c] = identity;
+            for (std::size_t w = 0; w < wordCount; ++w) {
+                bitmap_word bits = words[w];
+                const T* src = data + w * word_bits;
+                if (bits == 0)
+                    continue;
+                if (w < wholeWords) {
+                    for (unsigned k = 0; k < word_bits; k += chains) {
+                        for (unsigned c = 0; c < chains; ++c)
+                            lanes[c] = reduce(lanes[c], ((bits >> (k + c)) & 1u) ? src[k + c] : identity); // select, not a branch
+                    }
+                    continue;
+                }
+                for (; bits != 0; bits &= bits - 1)
+                    lanes[0] = reduce(lanes[0], src[countr_zero(bits)]);
+            }
+            for (unsigned c = 0; c < chains; ++c)
+                acc = reduce(acc, lanes[c]);
+            return acc;
+        }
+        // any other operation sees live values only, in index order
+        template<class T, class ReduceT>
+        T reduce_selected(const bitmap_word* words, const T* data, std::size_t wordCount, std::size_t, T acc, ReduceT& reduce, std::false_type) {
+            for (std::size_t w = 0; w < wordCount; ++w) {
+                bitmap_word bits = words[w];
+                const T* src = data + w * word_bits;
+                if (bits == ~bitmap_word(0)) {
+                    for (unsigned k = 0; k < word_bits; ++k)
+                        acc = reduce(acc, src[k]);
+                    continue;
+                }
+                for (; bits != 0; bits &= bits - 1)
+                    acc = reduce(acc, src[countr_zero(bits)]);
+            }
+            return acc;
+        }
+        template<class T, class ReduceT>
+        T reduce_words(const bitmap_word* words, const T* data, std::size_t wordCount, std::size_t wholeWords, T acc, ReduceT& reduce, std::false_type) {
+            return reduce_selected(words, data, wordCount, wholeWords, acc, reduce, std::integral_constant<bool, has_builtin_reduce<T, ReduceT>::value>());
+        }
+    };
+
+    // reduce(init, live values...) with plus_op, min_op, max_op or your own operation.
+    // The built-in ones over arithmetic T read whole words and select identity for holes, in masked AVX-512 lanes
+    // for float, double, int32 and int64, in 8 accumulators otherwise. Lanes and accumulators are folded in a different
+    // order than index order, float results may differ from a sequential sum in the last bits.
+    // Your own operation is called on live values only, in index order.
+    template<class VectorT, class ReduceT>
+    typename VectorT::value_type reduce_live(const VectorT& v, typename VectorT::value_type init, ReduceT reduce) {
+        typedef typename VectorT::value_type value_type;
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        return details::reduce_words(v.get_bitmap().words(), v.data(), wordCount, details::whole_words(v), init, reduce,
+            std::integral_constant<bool, details::has_avx512_reduce<value_type, ReduceT>::value>());
+    }
+    // number of live values with pred(value), pred never sees a hole
+    template<class VectorT, class PredT>
+    typename VectorT::size_type count_if_live(const VectorT& v, PredT pred) {
+        typedef typename VectorT::value_type value_type;
+        const details::bitmap_word* words = v.get_bitmap().words();
+        const value_type* data = v.data();
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        typename VectorT::size_type count = 0;
+        for (std::size_t w = 0; w < wordCount; ++w) {
+            details::bitmap_word bits = words[w];
+            const value_type* src = data + w * details::word_bits;
+            if (bits == ~details::bitmap_word(0)) {
+                for (unsigned k = 0; k < details::word_bits; ++k)
+                    count += pred(src[k]) ? 1 : 0;
+                continue;
+            }
+            for (; bits != 0; bits &= bits - 1)
+                count += pred(src[details::countr_zero(bits)]) ? 1 : 0;
+        }
+        return count;
+    }
+    // true if pred(value) holds for some live value, stops at the first word that has one, pred never sees a hole
+    template<class VectorT, class PredT>
+    bool any_of_live(const VectorT& v, PredT pred) {
+        typedef typename VectorT::value_type value_type;
+        const details::bitmap_word* words = v.get_bitmap().words();
+        const value_type* data = v.data();
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        for (std::size_t w = 0; w < wordCount; ++w) {
+            details::bitmap_word bits = words[w];
+            const value_type* src = data + w * details::word_bits;
+            if (bits == ~details::bitmap_word(0)) {
+                bool hit = false;
+                for (unsigned k = 0; k < details::word_bits; ++k)
+                    hit |= static_cast<bool>(pred(src[k]));
+                if (hit)
+                    return true;
+                continue;
+            }
+            for (; bits != 0; bits &= bits - 1) {
+                if (pred(src[details::countr_zero(bits)]))
+                    return true;
+            }
+        }
+        return false;
+    }
+    // value = funct(value) for every live value, funct never sees a hole and holes are never written
+    template<class VectorT, class FunctT>
+    void transform_live(VectorT& v, FunctT funct) {
+        typedef typename VectorT::value_type value_type;
+        const details::bitmap_word* words = v.get_bitmap().words();
+        value_type* data = v.data();
+        const std::size_t wordCount = (static_cast<std::size_t>(v.size()) + details::word_bits - 1) / details::word_bits;
+        for (std::size_t w = 0; w < wordCount; ++w) {
+            details::bitmap_word bits = words[w];
+            value_type* dst = data + w * details::word_bits;
+            if (bits == ~details::bitmap_word(0)) {
+                for (unsigned k = 0; k < details::word_bits; ++k)
+                    dst[k] = funct(dst[k]);
+                continue;
+            }
+            for (; bits != 0; bits &= bits - 1) {
+                value_type& x = dst[details::countr_zero(bits)];
+                x = funct(x);
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,365 @@
+/*  static_sparse_vector.hpp
+    MIT License
+
+    Copyright (c) 2024 Aidar Shigapov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+*/
+
+#ifndef STATIC_SPARSE_VECTOR_HPP_
+#define STATIC_SPARSE_VECTOR_HPP_ 1
+
+#include "sparse_vector.hpp"
+
+namespace sv {
+    namespace details {
+        // smallest unsigned type that holds N
+        template<std::uint64_t N>
+        struct smallest_index {
+            typedef typename std::conditional<(N <= 0xffu), std::uint8_t,
+                typename std::conditional<(N <= 0xffffu), std::uint16_t,
+                typename std::conditional<(N <= 0xffffffffu), std::uint32_t, std::uint64_t>::type>::type>::type type;
+        };
+
+        template<class T, class... ArgsT>
+        SPARSE_VECTOR_CONSTEXPR20 void construct_in(T* where, ArgsT&&... args) {
+#if ((defined __cplusplus) && (__cplusplus >= 202002L))
+            std::construct_at(where, std::forward<ArgsT>(args)...);
+#else
+            new(where)T(std::forward<ArgsT>(args)...);
+#endif
+        }
+    };
+
+    /*
+        sparse_vector with a fixed capacity of N slots inline, no allocation ever happens and push_free has no growth path.
+        Occupancy is a fixed array of N bits, holes are kept in a fixed LIFO of index_type, the smallest type that holds N.
+        push_free, emplace_free, erase_at, the lookups and iteration are constexpr under C++20.
+        Same push_free/erase_at/exist_at/at/iteration API as sparse_vector, push_free on a full vector throws std::length_error.
+    */
+    template <class T, SPARSE_VECTOR_SIZE_TYPE N>
+    class static_sparse_vector {
+        public:
+        typedef T value_type;
+        typedef T& referens;
+        typedef const T& const_referens;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef SPARSE_VECTOR_SIZE_TYPE size_type;
+        typedef typename details::smallest_index<N>::type index_type;
+        static const size_type static_capacity = N;
+
+        static_assert(N != 0, "static_sparse_vector needs N > 0.");
+
+        private:
+        static const size_type words = (N + details::word_bits - 1) / details::word_bits;
+
+        // raw slot, the value member is alive only while its bit is set
+        union slot {
+            value_type value;
+
+            SPARSE_VECTOR_CONSTEXPR20 slot() noexcept {
+            }
+            SPARSE_VECTOR_CONSTEXPR20 ~slot() {
+            }
+        };
+
+        private:
+        slot slots_[N];
+        details::bitmap_word bits_[words];
+        index_type free_[N];
+        index_type freeCount_;
+        index_type size_;
+        index_type liveCount_;
+
+        private:
+        [[nodiscard]] constexpr bool test(size_type i) const noexcept {
+            return (bits_[i / details::word_bits] >> (i % details::word_bits)) & 1u;
+        }
+        SPARSE_VECTOR_CONSTEXPR20 void set(size_type i) noexcept {
+            bits_[i / details::word_bits] |= details::bitmap_word(1) << (i % details::word_bits);
+        }
+        SPARSE_VECTOR_CONSTEXPR20 void reset(size_type i) noexcept {
+            bits_[i / details::word_bits] &= ~(details::bitmap_word(1) << (i % details::word_bits));
+        }
+        SPARSE_VECTOR_CONSTEXPR20 void destroy(size_type i) noexcept {
+            slots_[i].value.~value_type();
+        }
+        // reuses a hole or appends a slot, skips stale holes cut off by pop_back.
+        // Appends only with an empty free list, so no index is listed twice and free_ never holds more than N.
+        SPARSE_VECTOR_CONSTEXPR20 size_type claim_index() {
+            while (freeCount_ != 0) {
+                const size_type index = free_[--freeCount_];
+                if (index < size_)
+                    return index;
+            }
+            if (size_ == N)
+                throw std::length_error("static_sparse_vector is full. push_free.");
+            return size_++;
+        }
+        template<class... ArgsT>
+        SPARSE_VECTOR_CONSTEXPR20 void construct_at(size_type i, ArgsT&&... args) {
+            details::construct_in(&slots_[i].value, std::forward<ArgsT>(args)...);
+            set(i);
+            ++liveCount_;
+        }
+        // takes hole i off the free list once emplace_at has filled it, erase_at lists it again
+        SPARSE_VECTOR_CONSTEXPR20 void unlist(size_type i) noexcept {
+            for (size_type k = freeCount_; k != 0; --k) {
+                if (free_[k - 1] == i) {
+                    for (; k < freeCount_; ++k)
+                        free_[k - 1] = free_[k];
+                    --freeCount_;
+                    return;
+                }
+            }
+        }
+        template<class OtherT>
+        SPARSE_VECTOR_CONSTEXPR20 void copy_from(OtherT& other) {
+            typedef typename std::conditional<std::is_const<OtherT>::value, const value_type&, value_type&&>::type source_type;
+            for (size_type i = 0; i < other.size_; ++i) {
+                if (other.test(i))
+                    construct_at(i, static_cast<source_type>(other.slots_[i].value));
+                size_ = static_cast<index_type>(i + 1); // destroy_live sees what was built on throw
+            }
+            for (size_type i = 0; i < other.freeCount_; ++i)
+                free_[i] = other.free_[i];
+            freeCount_ = other.freeCount_;
+        }
+        SPARSE_VECTOR_CONSTEXPR20 void destroy_live() noexcept {
+            if (std::is_trivially_destructible<value_type>::value)
+                return;
+            for (size_type i = 0; i < size_; ++i) {
+                if (test(i))
+                    destroy(i);
+            }
+        }
+
+        public:
+        SPARSE_VECTOR_CONSTEXPR20 static_sparse_vector() noexcept : slots_(), bits_(), freeCount_(0), size_(0), liveCount_(0) {
+        }
+        SPARSE_VECTOR_CONSTEXPR20 static_sparse_vector(const static_sparse_vector& other) : static_sparse_vector() {
+            copy_from(other); // delegated constructor is done, destructor cleans up on throw
+        }
+        SPARSE_VECTOR_CONSTEXPR20 static_sparse_vector(static_sparse_vector&& other) : static_sparse_vector() {
+            copy_from(other);
+            other.clear();
+        }
+        SPARSE_VECTOR_CONSTEXPR20 static_sparse_vector(std::initializer_list<value_type> values) : static_sparse_vector() {
+            if (values.size() > N)
+                throw std::length_error("static_sparse_vector is full. initializer_list.");
+            for (const value_type& value : values)
+                construct_at(size_++, value);
+        }
+
+        public:
+        SPARSE_VECTOR_CONSTEXPR20 static_sparse_vector& operator=(const static_sparse_vector& other) {
+            if (this != &other) {
+                clear();
+                copy_from(other);
+            }
+            return *this;
+        }
+        SPARSE_VECTOR_CONSTEXPR20 static_sparse_vector& operator=(static_sparse_vector&& other) {
+            if (this != &other) {
+                clear();
+                copy_from(other);
+                other.clear();
+            }
+            return *this;
+        }
+
+        public:
+        SPARSE_VECTOR_CONSTEXPR20 ~static_sparse_vector() {
+            destroy_live();
+        }
+
+        public:
+        SPARSE_VECTOR_CONSTEXPR20 size_type push_free(const_referens val) {
+            const size_type index = claim_index();
+            construct_at(index, val);
+            return index;
+        }
+        template<class... ArgsT>
+        SPARSE_VECTOR_CONSTEXPR20 size_type emplace_free(ArgsT&&... args) {
+            const size_type index = claim_index();
+            construct_at(index, std::forward<ArgsT>(args)...);
+            return index;
+        }
+        SPARSE_VECTOR_CONSTEXPR20 void erase_at(size_type index) {
+            if (index >= size_)
+                throw std::out_of_range("out of static_sparse_vector range on erase_at.");
+            if (!test(index))
+                throw std::out_of_range("value doesnt exist in static_sparse_vector on this index. erase_at.");
+            destroy(index);
+            reset(index);
+            --liveCount_;
+            free_[freeCount_++] = static_cast<index_type>(index);
+        }
+        SPARSE_VECTOR_CONSTEXPR20 void pop_back() {
+            if (size_ == 0)
+                throw std::out_of_range("static_sparse_vector is empty on pop_back.");
+            --size_;
+            if (test(size_)) {
+                destroy(size_);
+                reset(size_);
+                --liveCount_;
+            }
+        }
+        template<class... ArgsT>
+        SPARSE_VECTOR_CONSTEXPR20 void emplace_at(size_type i, ArgsT&&... args) {
+            if (size_ <= i)
+                throw std::out_of_range("index out of static_sparse_vector size on emplace_at.");
+            if (test(i))
+                throw std::out_of_range("value already exist in static_sparse_vector on this index. emplace_at.");
+            construct_at(i, std::forward<ArgsT>(args)...);
+            unlist(i);
+        }
+        SPARSE_VECTOR_CONSTEXPR20 void clear() noexcept {
+            destroy_live();
+            for (size_type w = 0; w < words; ++w)
+                bits_[w] = 0;
+            freeCount_ = 0;
+            size_ = 0;
+            liveCount_ = 0;
+        }
+
+        public:
+        [[nodiscard]] constexpr bool exist_at(size_type i) const noexcept {
+            return i < size_ && test(i);
+        }
+        [[nodiscard]] constexpr size_type size() const noexcept {
+            return size_;
+        }
+        [[nodiscard]] static constexpr size_type capacity() noexcept {
+            return N;
+        }
+        [[nodiscard]] constexpr size_type live_count() const noexcept {
+            return liveCount_;
+        }
+        [[nodiscard]] constexpr size_type free_count() const noexcept {
+            return size_ - liveCount_;
+        }
+        [[nodiscard]] constexpr bool full() const noexcept {
+            return liveCount_ == N;
+        }
+
+        public:
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 referens operator[](size_type i) noexcept {
+            return slots_[i].value;
+        }
+        [[nodiscard]] constexpr const_referens operator[](size_type i) const noexcept {
+            return slots_[i].value;
+        }
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 referens at(size_type i) {
+            if (size_ <= i)
+                throw std::out_of_range("index out of static_sparse_vector size on at.");
+            if (!test(i))
+                throw std::out_of_range("value doesnt exist in static_sparse_vector on this index. at.");
+            return slots_[i].value;
+        }
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 const_referens at(size_type i) const {
+            if (size_ <= i)
+                throw std::out_of_range("index out of static_sparse_vector size on at.");
+            if (!test(i))
+                throw std::out_of_range("value doesnt exist in static_sparse_vector on this index. at.");
+            return slots_[i].value;
+        }
+        // first existing index >= i or size(), skips 64 holes per step
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 size_type find_next_live(size_type i) const noexcept {
+            return details::scan_words<size_type>(bits_, i, size_, 0);
+        }
+
+        public:
+        template<class OwnerT, class ValueT>
+        struct basic_iterator {
+            public:
+            typedef T value_type;
+            typedef ValueT& referens;
+            typedef const T& const_referens;
+            typedef ValueT* pointer;
+            typedef const T* const_pointer;
+            typedef ValueT& reference;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::forward_iterator_tag iterator_category;
+
+            private:
+            friend class static_sparse_vector;
+            OwnerT* owner_;
+            size_type index_;
+
+            public:
+            SPARSE_VECTOR_CONSTEXPR20 basic_iterator() noexcept : owner_(nullptr), index_(0) {
+            }
+            SPARSE_VECTOR_CONSTEXPR20 basic_iterator(OwnerT* owner, size_type index) noexcept : owner_(owner), index_(owner->find_next_live(index)) {
+            }
+
+            public:
+            [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 pointer operator->() const noexcept {
+                return &(*owner_)[index_];
+            }
+            [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 reference operator*() const noexcept {
+                return (*owner_)[index_];
+            }
+
+            public:
+            SPARSE_VECTOR_CONSTEXPR20 basic_iterator& operator++() noexcept {
+                index_ = owner_->find_next_live(index_ + 1);
+                return *this;
+            }
+            SPARSE_VECTOR_CONSTEXPR20 basic_iterator operator++(int) noexcept {
+                basic_iterator old = *this;
+                ++(*this);
+                return old;
+            }
+
+            public:
+            [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 bool operator==(const basic_iterator& other) const noexcept {
+                return index_ == other.index_;
+            }
+            [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 bool operator!=(const basic_iterator& other) const noexcept {
+                return index_ != other.index_;
+            }
+        };
+        typedef basic_iterator<static_sparse_vector, value_type> iterator;
+        typedef basic_iterator<const static_sparse_vector, const value_type> const_iterator;
+
+        public:
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 iterator begin() noexcept {
+            return iterator(this, 0);
+        }
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 iterator end() noexcept {
+            return iterator(this, size_);
+        }
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 const_iterator begin() const noexcept {
+            return const_iterator(this, 0);
+        }
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 const_iterator end() const noexcept {
+            return const_iterator(this, size_);
+        }
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 size_type index_of(const iterator& i) const noexcept {
+            return i.index_;
+        }
+        [[nodiscard]] SPARSE_VECTOR_CONSTEXPR20 size_type index_of(const const_iterator& i) const noexcept {
+            return i.index_;
+        }
+    };
+};
+#endif
@@ -0,0 +1,144 @@
+/*  concurrent_sparse_vector_test.cpp
+    Tests of concurrent_sparse_vector with many producers and consumers at once.
+
+    Build (C++11 or later, run it under -fsanitize=thread too):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. concurrent_sparse_vector_test.cpp -lpthread -o concurrent_sparse_vector_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../concurrent_sparse_vector.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    std::string value_of(std::size_t thread, std::size_t i) {
+        return std::string(24, static_cast<char>('a' + thread)) + std::to_string(i); // past the small string buffer
+    }
+
+    // every thread pushes, erases part of what it pushed, reads its own values back and erases values of its neighbour,
+    // what is left must be exactly the values nobody erased
+    void test_producers_and_consumers() {
+        typedef sv::concurrent_sparse_vector<std::string, 64> vector_type;
+        const std::size_t threadCount = 8, perThread = 3000;
+        vector_type v;
+        std::vector<std::vector<vector_type::size_type>> kept(threadCount);
+        std::vector<std::vector<std::string>> keptValues(threadCount);
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&v, &kept, &keptValues, t, perThread]() {
+                for (std::size_t i = 0; i < perThread; ++i) {
+                    const std::string value = value_of(t, i);
+                    const vector_type::size_type index = i % 2 ? v.push_free(value) : v.emplace_free(value);
+                    if (i % 3 == 0) {
+                        v.erase_at(index);
+                        continue;
+                    }
+                    kept[t].push_back(index);
+                    keptValues[t].push_back(value);
+                    const std::size_t back = kept[t].size() / 2;
+                    SV_CHECK(v.exist_at(kept[t][back]) && v.at(kept[t][back]) == keptValues[t][back]);
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+
+        // every thread erases the odd half of the next thread's values while pushing more of its own
+        threads.clear();
+        std::vector<std::vector<vector_type::size_type>> more(threadCount);
+        for (std::size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&v, &kept, &more, t, threadCount, perThread]() {
+                const std::vector<vector_type::size_type>& victims = kept[(t + 1) % threadCount];
+                for (std::size_t k = 1; k < victims.size(); k += 2) {
+                    v.erase_at(victims[k]);
+                    more[t].push_back(v.push_free(value_of(t, perThread + k)));
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+
+        std::multiset<std::string> model;
+        for (std::size_t t = 0; t < threadCount; ++t) {
+            for (std::size_t k = 0; k < keptValues[t].size(); k += 2)
+                model.insert(keptValues[t][k]);
+            const std::vector<vector_type::size_type>& victims = kept[(t + 1) % threadCount];
+            for (std::size_t k = 1, m = 0; k < victims.size(); k += 2, ++m) {
+                SV_CHECK(v.at(more[t][m]) == value_of(t, perThread + k));
+                model.insert(value_of(t, perThread + k));
+            }
+        }
+        std::multiset<std::string> live;
+        v.for_each_live([&live](vector_type::size_type, const std::string& value) { live.insert(value); });
+        SV_CHECK(v.live_count() == model.size());
+        SV_CHECK(live == model);
+    }
+
+    bool failNext = false;
+    // fails the next allocation while failNext is set
+    template <class T>
+    struct failing_allocator {
+        typedef T value_type;
+
+        failing_allocator() noexcept {
+        }
+        template <class U>
+        failing_allocator(const failing_allocator<U>&) noexcept {
+        }
+        T* allocate(std::size_t n) {
+            if (failNext)
+                throw std::bad_alloc();
+            return std::allocator<T>().allocate(n);
+        }
+        void deallocate(T* p, std::size_t n) noexcept {
+            std::allocator<T>().deallocate(p, n);
+        }
+        template <class U>
+        bool operator==(const failing_allocator<U>&) const noexcept {
+            return true;
+        }
+        template <class U>
+        bool operator!=(const failing_allocator<U>&) const noexcept {
+            return false;
+        }
+    };
+
+    // a segment that can't be allocated claims no index
+    void test_segment_bad_alloc() {
+        sv::concurrent_sparse_vector<std::size_t, 64, failing_allocator<std::size_t>> v;
+        for (std::size_t i = 0; i < 64; ++i)
+            v.push_free(i);
+        failNext = true;
+        bool threw = false;
+        try {
+            v.push_free(64);
+        } catch (const std::bad_alloc&) {
+            threw = true;
+        }
+        failNext = false;
+        SV_CHECK(threw && v.size() == 64 && v.live_count() == 64 && !v.exist_at(64));
+        SV_CHECK(v.push_free(64) == 64);
+        SV_CHECK(v.size() == 65 && v.at(64) == 64);
+    }
+};
+
+int main() {
+    test_producers_and_consumers();
+    test_segment_bad_alloc();
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*  handle_sparse_vector_test.cpp
+    Tests of handle_sparse_vector: stale handles, growth, copies and clear.
+
+    Build (C++11 or later, run it under the sanitizers):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. handle_sparse_vector_test.cpp -o handle_sparse_vector_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../handle_sparse_vector.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    typedef sv::handle_sparse_vector<std::string> vector_type;
+    typedef vector_type::handle handle;
+
+    std::string value_of(std::size_t i) {
+        return std::string(24, static_cast<char>('a' + i % 26)) + std::to_string(i);
+    }
+
+    void test_stale_handles() {
+        vector_type v;
+        const handle a = v.push_free("a");
+        const handle b = v.emplace_free(3, 'b');
+        SV_CHECK(v.at(a) == "a" && *v.try_get(b) == "bbb");
+        v.erase(a);
+        SV_CHECK(!v.contains(a) && v.try_get(a) == nullptr && !v.exist_at(a.index));
+        const handle c = v.push_free("c");
+        SV_CHECK(c.index == a.index && c != a && v.at(c) == "c");
+        bool thrown = false;
+        try {
+            v.erase(a);
+        } catch (const std::out_of_range&) {
+            thrown = true;
+        }
+        SV_CHECK(thrown && v.live_count() == 2);
+        SV_CHECK(v.handle_of(b.index) == b && sv::sparse_handle::from_bits(b.to_bits()) == b);
+        v.clear();
+        SV_CHECK(!v.contains(b) && !v.contains(c) && v.live_count() == 0 && v.size() == 0);
+        const handle d = v.push_free("d");
+        SV_CHECK(v.at(d) == "d" && d != b && d != c);
+    }
+
+    // values move on growth, handles keep working, erased ones never come back
+    void test_growth_and_reuse() {
+        vector_type v;
+        std::vector<handle> live, dead;
+        for (std::size_t i = 0; i < 3000; ++i) {
+            live.push_back(v.push_free(value_of(i)));
+            if (i % 4 == 1) {
+                v.erase(live[live.size() / 2]);
+                dead.push_back(live[live.size() / 2]);
+                live.erase(live.begin() + static_cast<std::ptrdiff_t>(live.size() / 2));
+            }
+        }
+        SV_CHECK(v.live_count() == live.size());
+        for (const handle& h : live)
+            SV_CHECK(v.contains(h) && v.handle_of(h.index) == h);
+        for (const handle& h : dead)
+            SV_CHECK(!v.contains(h));
+        std::size_t count = 0;
+        for (vector_type::iterator it = v.begin(); it != v.end(); ++it, ++count)
+            SV_CHECK(v.contains(v.handle_of(it)) && *it == v.at(v.handle_of(it)));
+        SV_CHECK(count == live.size());
+    }
+
+    // a copy shares the handles of the source, stale ones included, and owns its values
+    void test_copy() {
+        vector_type v;
+        const handle a = v.push_free(value_of(1));
+        const handle b = v.push_free(value_of(2));
+        v.erase(a);
+        vector_type copy(v);
+        SV_CHECK(copy.at(b) == value_of(2) && !copy.contains(a));
+        const handle c = copy.push_free(value_of(3));
+        SV_CHECK(c.index == a.index && c != a);
+        copy.at(b) = "changed";
+        SV_CHECK(v.at(b) == value_of(2));
+        vector_type moved(SPARSE_VECTOR_MOVE(copy));
+        SV_CHECK(moved.at(b) == "changed" && moved.at(c) == value_of(3) && copy.live_count() == 0);
+        v = moved;
+        SV_CHECK(v.at(c) == value_of(3) && v.live_count() == 2);
+    }
+
+    struct throws_on {
+        int value;
+        throws_on(int v) : value(v) {
+            if (v < 0)
+                throw std::runtime_error("throws_on");
+        }
+    };
+
+    // a throwing constructor leaves the vector as it was
+    void test_throwing_insert() {
+        sv::handle_sparse_vector<throws_on> v;
+        const handle a = v.emplace_free(1);
+        v.erase(a);
+        bool thrown = false;
+        try {
+            v.emplace_free(-1);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        SV_CHECK(thrown && v.live_count() == 0 && v.size() == 1);
+        const handle b = v.emplace_free(2);
+        SV_CHECK(b.index == a.index && b != a && v.at(b).value == 2);
+    }
+};
+
+int main() {
+    test_stale_handles();
+    test_growth_and_reuse();
+    test_copy();
+    test_throwing_insert();
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*  paged_sparse_vector_test.cpp
+    Tests of paged_sparse_vector and its copy-on-write snapshots.
+
+    Build (C++11 or later, run it under the sanitizers):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. paged_sparse_vector_test.cpp -o paged_sparse_vector_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../paged_sparse_vector.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    typedef sv::paged_sparse_vector<std::string, 64> vector_type;
+
+    std::string value_of(std::size_t i) {
+        return std::string(24, static_cast<char>('a' + i % 26)) + std::to_string(i);
+    }
+
+    // shrinking resize destroys what it cuts off, size() and live_count() agree afterwards
+    void test_resize_shrinks() {
+        vector_type v;
+        for (std::size_t i = 0; i < 200; ++i)
+            v.push_free(value_of(i));
+        v.erase_at(10);
+        v.erase_at(150);
+        v.resize(100);
+        SV_CHECK(v.size() == 100 && v.live_count() == 99 && v.free_count() == 1);
+        SV_CHECK(!v.exist_at(150) && !v.exist_at(100));
+        SV_CHECK(v.push_free(value_of(10)) == 10);
+        SV_CHECK(v.push_free(value_of(100)) == 100);
+        std::size_t count = 0;
+        for (vector_type::const_iterator it = static_cast<const vector_type&>(v).begin(); it != static_cast<const vector_type&>(v).end(); ++it, ++count)
+            SV_CHECK(*it == value_of(v.index_of(it)));
+        SV_CHECK(count == v.live_count());
+        v.resize(0);
+        SV_CHECK(v.size() == 0 && v.live_count() == 0);
+    }
+
+    // the snapshot keeps the values that resize cuts off
+    void test_resize_keeps_snapshot() {
+        vector_type v;
+        for (std::size_t i = 0; i < 130; ++i)
+            v.push_free(value_of(i));
+        const vector_type::snapshot_type snap = v.snapshot();
+        v.resize(30);
+        SV_CHECK(v.size() == 30 && v.live_count() == 30);
+        SV_CHECK(snap.size() == 130 && snap.live_count() == 130);
+        for (std::size_t i = 0; i < 130; ++i)
+            SV_CHECK(snap.at(i) == value_of(i));
+    }
+
+    // const deref of a mutable iterator reads the shared page, it does not clone it
+    void test_const_deref_does_not_clone() {
+        vector_type v;
+        for (std::size_t i = 0; i < 10; ++i)
+            v.push_free(value_of(i));
+        const vector_type::snapshot_type snap = v.snapshot();
+        const vector_type::iterator it = v.begin();
+        SV_CHECK(&*it == &snap[0]);
+        SV_CHECK(it->size() == snap[0].size());
+        vector_type::iterator writer = v.begin();
+        *writer = "changed";
+        SV_CHECK(snap[0] == value_of(0) && v[0] == "changed");
+    }
+
+    // a hole filled by emplace_at is not handed out again
+    void test_emplace_at_unlinks_hole() {
+        vector_type v;
+        for (std::size_t i = 0; i < 8; ++i)
+            v.push_free(value_of(i));
+        v.erase_at(2);
+        v.erase_at(5);
+        v.emplace_at(5, value_of(50));
+        SV_CHECK(v.push_free(value_of(20)) == 2);
+        SV_CHECK(v.push_free(value_of(80)) == 8);
+        SV_CHECK(v.at(5) == value_of(50) && v.live_count() == 9);
+    }
+};
+
+int main() {
+    test_resize_shrinks();
+    test_resize_keeps_snapshot();
+    test_const_deref_does_not_clone();
+    test_emplace_at_unlinks_hole();
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*  sharded_sparse_vector_test.cpp
+    Tests of sharded_sparse_vector with more threads than shards.
+
+    Build (C++11 or later, run it under -fsanitize=thread too):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. sharded_sparse_vector_test.cpp -lpthread -o sharded_sparse_vector_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../sharded_sparse_vector.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    typedef sv::sharded_sparse_vector<std::string, 4> vector_type;
+
+    // 8 threads on 2 shards, four writers share every shard, erases go to own and other shards
+    void test_threads_share_shards() {
+        const std::size_t threadCount = 8, perThread = 2000;
+        vector_type v(2);
+        std::vector<std::vector<vector_type::size_type>> indices(threadCount);
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&v, &indices, t, perThread]() {
+                std::vector<vector_type::size_type>& own = indices[t];
+                for (std::size_t i = 0; i < perThread; ++i) {
+                    own.push_back(v.push_free(std::string(32, static_cast<char>('a' + t)) + std::to_string(i)));
+                    if (i % 3 == 0) {
+                        v.erase_at(own.back());
+                        own.pop_back();
+                    }
+                }
+                v.flush();
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        std::size_t kept = 0;
+        for (std::size_t t = 0; t < threadCount; ++t) {
+            for (vector_type::size_type index : indices[t]) {
+                SV_CHECK(v.exist_at(index) && v.at(index)[0] == static_cast<char>('a' + t));
+                ++kept;
+            }
+        }
+        SV_CHECK(v.live_count() == kept);
+
+        // every thread erases the values of another one, most of them through the inbox of another shard
+        threads.clear();
+        for (std::size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&v, &indices, t, threadCount]() {
+                for (vector_type::size_type index : indices[(t + 1) % threadCount])
+                    v.erase_at(index);
+                v.push_free("flushes own inbox");
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        v.flush_all();
+        SV_CHECK(v.live_count() == threadCount);
+    }
+
+    // erasing an index that is not live does nothing on the own shard and through another shard's inbox alike
+    void test_erase_not_live() {
+        vector_type v(4);
+        const vector_type::size_type own = v.push_free("own");
+        const vector_type::size_type other = vector_type::make_index((v.local_shard() + 1) % 4, 0);
+        v.erase_at(own);
+        v.erase_at(own);
+        v.erase_at(vector_type::make_index(v.local_shard(), 100));
+        v.erase_at(other);
+        v.erase_at(vector_type::make_index((v.local_shard() + 2) % 4, 7));
+        v.flush_all();
+        SV_CHECK(v.live_count() == 0 && !v.exist_at(own));
+        SV_CHECK(v.push_free("again") == own);
+        bool threw = false;
+        try {
+            v.erase_at(vector_type::make_index(5, 0));
+        } catch (const std::out_of_range&) {
+            threw = true;
+        }
+        SV_CHECK(threw && v.live_count() == 1);
+    }
+};
+
+int main() {
+    test_threads_share_shards();
+    test_erase_not_live();
+    std::puts("ok");
+    return 0;
+}
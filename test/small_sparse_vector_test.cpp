@@ -0,0 +1,85 @@
+/*  small_sparse_vector_test.cpp
+    Tests of small_sparse_vector spilling to the heap and coming back inline.
+
+    Build (C++11 or later, run it under the sanitizers):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. small_sparse_vector_test.cpp -o small_sparse_vector_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../small_sparse_vector.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    template <class T>
+    T value_of(std::size_t i) {
+        return static_cast<T>(i * 7 + 1);
+    }
+    template <>
+    std::string value_of<std::string>(std::size_t i) {
+        return std::string(24, static_cast<char>('a' + i % 26)) + std::to_string(i); // past the small string buffer
+    }
+
+    template <class VectorT>
+    bool bits_inline(const VectorT& v) {
+        const char* words = reinterpret_cast<const char*>(v.get_bitmap().words());
+        return words >= reinterpret_cast<const char*>(&v) && words < reinterpret_cast<const char*>(&v + 1);
+    }
+
+    // free indices made while spilled do not take the inline occupancy words, shrink_to_fit brings both parts back
+    template <class T>
+    void test_spill_and_return() {
+        typedef sv::small_sparse_vector<T, 64> vector_type;
+        vector_type v;
+        SV_CHECK(v.is_inline() && bits_inline(v));
+        for (std::size_t i = 0; i < 200; ++i)
+            v.push_free(value_of<T>(i));
+        SV_CHECK(!v.is_inline() && !bits_inline(v));
+        v.erase_at(10);
+        v.erase_at(20);
+        v.erase_at(150);
+        for (std::size_t i = 0; i < 150; ++i)
+            v.pop_back();
+        v.shrink_to_fit();
+        SV_CHECK(v.is_inline() && bits_inline(v));
+        SV_CHECK(v.size() == 50 && v.live_count() == 48);
+        const std::size_t a = v.push_free(value_of<T>(1000));
+        const std::size_t b = v.push_free(value_of<T>(1001));
+        SV_CHECK((a == 10 && b == 20) || (a == 20 && b == 10));
+        SV_CHECK(v.push_free(value_of<T>(1002)) == 50);
+        for (std::size_t i = 0; i < 50; ++i)
+            SV_CHECK(i == a || i == b || v.at(i) == value_of<T>(i));
+    }
+
+    // copies and moves stay inline and keep indices
+    void test_copy_keeps_indices() {
+        typedef sv::small_sparse_vector<std::string, 8> vector_type;
+        vector_type v;
+        for (std::size_t i = 0; i < 8; ++i)
+            v.push_free(std::string(24, static_cast<char>('a' + i)));
+        v.erase_at(3);
+        vector_type copy(v);
+        vector_type moved(SPARSE_VECTOR_MOVE(copy));
+        SV_CHECK(moved.is_inline() && bits_inline(moved));
+        SV_CHECK(moved.size() == 8 && moved.live_count() == 7 && !moved.exist_at(3));
+        SV_CHECK(moved.at(7) == std::string(24, 'h'));
+    }
+};
+
+int main() {
+    test_spill_and_return<std::uint64_t>();
+    test_spill_and_return<int>();
+    test_spill_and_return<std::string>();
+    test_copy_keeps_indices();
+    std::puts("ok");
+    return 0;
+}
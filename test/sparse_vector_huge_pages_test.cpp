@@ -0,0 +1,85 @@
+/*  sparse_vector_huge_pages_test.cpp
+    Smoke tests of huge_page_allocator on its malloc, MAP_HUGETLB and aligned mapping paths, alone and under sparse_vector.
+
+    Build (C++11 or later, run it under the sanitizers):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. sparse_vector_huge_pages_test.cpp -o sparse_vector_huge_pages_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../sparse_vector_huge_pages.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    // every byte of the block is writable, mapped blocks start on a page and usable_size fills their pages
+    template <class AllocatorT>
+    void test_block(std::size_t n, std::size_t pageBytes, bool mapped) {
+        AllocatorT allocator;
+        typename AllocatorT::value_type* p = allocator.allocate(n);
+        SV_CHECK(p != nullptr);
+        std::memset(static_cast<void*>(p), 0x5a, n * sizeof(*p));
+        const std::size_t usable = AllocatorT::usable_size(n);
+        SV_CHECK(usable >= n);
+#if (defined SPARSE_VECTOR_HAS_HUGE_PAGES)
+        if (mapped) {
+            SV_CHECK(reinterpret_cast<std::uintptr_t>(p) % pageBytes == 0);
+            SV_CHECK(usable * sizeof(*p) % pageBytes == 0 && (usable * sizeof(*p) - n * sizeof(*p)) < pageBytes);
+            std::memset(static_cast<void*>(p), 0x33, usable * sizeof(*p)); // the rounded up tail is mapped too
+        } else {
+            SV_CHECK(usable == n);
+        }
+#else
+        (void)pageBytes;
+        (void)mapped;
+        SV_CHECK(usable == n);
+#endif
+        allocator.deallocate(p, n);
+    }
+
+    void test_allocator() {
+        typedef sv::huge_page_allocator<std::uint64_t> default_allocator; // 2 MiB pages, MAP_HUGETLB first, aligned mapping when none are reserved
+        test_block<default_allocator>(1000, std::size_t(2) << 20, false);
+        test_block<default_allocator>((std::size_t(3) << 20) / 8, std::size_t(2) << 20, true);
+        typedef sv::huge_page_allocator<std::uint64_t, 64 << 10, 64 << 10> small_pages; // no MAP_HUGETLB, always the aligned mapping
+        test_block<small_pages>(100, 64 << 10, false);
+        test_block<small_pages>((200 << 10) / 8 + 3, 64 << 10, true);
+        SV_CHECK(small_pages::usable_size((200 << 10) / 8 + 3) == (256 << 10) / 8);
+        SV_CHECK(default_allocator() == sv::huge_page_allocator<char>() && !(default_allocator() != sv::huge_page_allocator<char>()));
+    }
+
+    // the pairing of the doc comment, values survive growth from malloc into mapped pages
+    void test_vector() {
+        typedef sv::huge_page_allocator<std::uint64_t, 64 << 10, 64 << 10> allocator_type;
+        typedef sv::sparse_vector<std::uint64_t, allocator_type, std::vector, sv::flat_bitmap, sv::stack_free_list, sv::page_rounded_growth<sv::doubling_growth, 64 << 10>> vector_type;
+        vector_type v;
+        for (std::size_t i = 0; i < 100000; ++i)
+            v.push_free(i * 3);
+        SV_CHECK(v.capacity() * sizeof(std::uint64_t) % (64 << 10) == 0);
+        for (std::size_t i = 0; i < 100000; i += 3)
+            v.erase_at(i);
+        v.shrink_to_fit(); // back to a block that is not a whole number of pages
+        for (std::size_t i = 0; i < 100000; ++i)
+            SV_CHECK(v.exist_at(i) == (i % 3 != 0) && (i % 3 == 0 || v[i] == i * 3));
+        const std::size_t size = v.size();
+        SV_CHECK(v.push_free(7) % 3 == 0 && v.size() == size);
+        vector_type copy(v);
+        SV_CHECK(copy.size() == v.size() && copy[1] == 3);
+    }
+};
+
+int main() {
+    test_allocator();
+    test_vector();
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*  sparse_vector_io_test.cpp
+    Tests of save/load of sparse_vector_io.hpp: contents and hole reuse order survive a round trip.
+
+    Build (C++11 or later, run it under the sanitizers):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. sparse_vector_io_test.cpp -o sparse_vector_io_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../sparse_vector_io.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    template <class VectorT>
+    void fill(VectorT& v) {
+        for (std::uint64_t i = 0; i < 300; ++i)
+            v.push_free(typename VectorT::value_type(i * 3));
+        const std::uint64_t erased[] = { 7, 250, 3, 128, 64, 199, 12, 299 }; // neither ascending nor descending
+        for (std::uint64_t i : erased)
+            v.erase_at(i);
+    }
+    template <class VectorT>
+    std::vector<std::uint64_t> reuse_order(VectorT v) {
+        std::vector<std::uint64_t> order;
+        while (v.free_count() != 0)
+            order.push_back(v.push_free(typename VectorT::value_type(0)));
+        return order;
+    }
+    template <class VectorT>
+    void check_same(const VectorT& a, const VectorT& b) {
+        SV_CHECK(a.size() == b.size() && a.live_count() == b.live_count());
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            SV_CHECK(a.exist_at(i) == b.exist_at(i));
+            if (a.exist_at(i))
+                SV_CHECK(a[i] == b[i]);
+        }
+        SV_CHECK(reuse_order(a) == reuse_order(b));
+    }
+
+    // raw and streamed formats keep values, holes and the order push_free reuses holes in
+    template <template <class> class BitmapT, template <class, class> class FreeListT>
+    void test_round_trip() {
+        typedef sv::sparse_vector<std::uint64_t, std::allocator<std::uint64_t>, std::vector, BitmapT, FreeListT> vector_type;
+        vector_type v;
+        fill(v);
+        v.pop_back(); // a cut off hole is not saved
+        std::stringstream raw;
+        sv::save(raw, v);
+        vector_type loaded;
+        loaded.push_free(42);
+        sv::load(raw, loaded);
+        check_same(v, loaded);
+
+        std::stringstream streamed;
+        sv::save(streamed, v, [](std::ostream& out, std::uint64_t x) { out.write(reinterpret_cast<const char*>(&x), sizeof(x)); });
+        vector_type reread;
+        sv::load(streamed, reread, [](std::istream& in) { std::uint64_t x = 0; in.read(reinterpret_cast<char*>(&x), sizeof(x)); return x; });
+        check_same(v, reread);
+    }
+
+    // counts the reads that reach the buffer
+    struct counting_buf : std::stringbuf {
+        std::size_t reads;
+
+        explicit counting_buf(const std::string& bytes) : std::stringbuf(bytes), reads(0) {
+        }
+
+        protected:
+        std::streamsize xsgetn(char* s, std::streamsize n) override {
+            ++reads;
+            return std::stringbuf::xsgetn(s, n);
+        }
+    };
+    // values of a raw file come in with one read, not one per value, holes at both ends and a cut short file included
+    template <template <class, class> class FreeListT>
+    void test_raw_block() {
+        typedef sv::sparse_vector<std::uint64_t, std::allocator<std::uint64_t>, std::vector, sv::flat_bitmap, FreeListT> vector_type;
+        vector_type v;
+        for (std::uint64_t i = 0; i < 1000; ++i)
+            v.push_free(i * 7);
+        for (std::uint64_t i = 0; i < 1000; i += 3)
+            v.erase_at(i); // 0 and 999 are holes
+        std::stringstream raw;
+        sv::save(raw, v);
+        const std::string bytes = raw.str();
+
+        counting_buf buf(bytes);
+        std::istream in(&buf);
+        vector_type loaded;
+        sv::load(in, loaded);
+        check_same(v, loaded);
+        SV_CHECK(buf.reads <= 5 && in.peek() == std::char_traits<char>::eof()); // header, occupancy, free list, padding, values
+
+        std::FILE* file = std::tmpfile();
+        SV_CHECK(file != nullptr);
+        sv::save(file, v);
+        std::rewind(file);
+        vector_type fromFile;
+        sv::load(file, fromFile);
+        check_same(v, fromFile);
+        std::fclose(file);
+
+        std::stringstream cut(bytes.substr(0, bytes.size() - 8));
+        vector_type broken;
+        bool threw = false;
+        try {
+            sv::load(cut, broken);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        SV_CHECK(threw && broken.size() == 0 && broken.live_count() == 0);
+
+        vector_type holes; // a single live value after a run of holes
+        for (std::uint64_t i = 0; i < 70; ++i)
+            holes.push_free(i);
+        for (std::uint64_t i = 0; i < 69; ++i)
+            holes.erase_at(i);
+        std::stringstream sparse;
+        sv::save(sparse, holes);
+        vector_type reread;
+        sv::load(sparse, reread);
+        check_same(holes, reread);
+        SV_CHECK(sparse.peek() == std::char_traits<char>::eof());
+    }
+
+    void test_strings() {
+        sv::sparse_vector<std::string> v;
+        for (std::size_t i = 0; i < 10; ++i)
+            v.push_free(std::string(20, 'a') + std::to_string(i));
+        v.erase_at(2);
+        v.erase_at(8);
+        v.erase_at(5);
+        std::stringstream streamed;
+        sv::save(streamed, v, [](std::ostream& out, const std::string& s) { out << s << '\n'; });
+        sv::sparse_vector<std::string> loaded;
+        sv::load(streamed, loaded, [](std::istream& in) { std::string s; std::getline(in, s); return s; });
+        SV_CHECK(loaded.size() == 10 && loaded.live_count() == 7 && loaded.at(9) == std::string(20, 'a') + "9");
+        SV_CHECK(loaded.push_free("x") == 5 && loaded.push_free("y") == 8 && loaded.push_free("z") == 2);
+    }
+};
+
+int main() {
+    test_round_trip<sv::flat_bitmap, sv::stack_free_list>();
+    test_round_trip<sv::flat_bitmap, sv::intrusive_free_list>();
+    test_round_trip<sv::flat_bitmap, sv::lowest_index_free_list>();
+    test_round_trip<sv::hierarchical_bitmap, sv::stack_free_list>();
+    test_round_trip<sv::dense_index_bitmap, sv::intrusive_free_list>();
+    test_raw_block<sv::stack_free_list>();
+    test_raw_block<sv::intrusive_free_list>();
+    test_raw_block<sv::lowest_index_free_list>();
+    test_strings();
+    std::puts("ok");
+    return 0;
+}
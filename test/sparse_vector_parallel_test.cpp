@@ -0,0 +1,91 @@
+/*  sparse_vector_parallel_test.cpp
+    Tests of for_each_live and transform_reduce_live of sparse_vector_parallel.hpp against the sequential loop.
+
+    Build (C++17 or later, the standard parallel policies may need TBB, run it under the sanitizers):
+        c++ -std=c++17 -g -fsanitize=address,undefined -I.. sparse_vector_parallel_test.cpp -ltbb -lpthread -o sparse_vector_parallel_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../sparse_vector_parallel.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    // executor that splits [0, count) between a few threads
+    struct thread_executor {
+        std::size_t threads;
+
+        template<class F>
+        void parallel_for(std::size_t count, F f) const {
+            std::vector<std::thread> workers;
+            for (std::size_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&f, count, t, this]() {
+                    for (std::size_t i = t; i < count; i += threads)
+                        f(i);
+                });
+            }
+            for (std::thread& worker : workers)
+                worker.join();
+        }
+    };
+
+    typedef sv::sparse_vector<std::uint64_t> vector_type;
+
+    vector_type make_vector(std::size_t count, std::size_t keepEvery) {
+        vector_type v;
+        for (std::size_t i = 0; i < count; ++i)
+            v.push_free(i * 3 + 1);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (i % keepEvery != 0 && i % 1000 >= 300) // a run of whole words stays live
+                v.erase_at(i);
+        }
+        return v;
+    }
+
+    // every live value visited exactly once, the sum matches the sequential loop
+    template<class ExecutorT>
+    void test_policy(ExecutorT&& policy) {
+        const std::size_t chunks[] = { 0, 1, 3, 64 };
+        const std::size_t densities[] = { 1, 7, 200 };
+        for (std::size_t keepEvery : densities) {
+            vector_type v = make_vector(20001, keepEvery); // the last word is partial
+            std::vector<std::atomic<int>> visits(v.size());
+            for (std::size_t chunkWords : chunks) {
+                for (std::atomic<int>& visit : visits)
+                    visit.store(0);
+                sv::for_each_live(policy, v, [&visits](vector_type::size_type i, std::uint64_t&) { visits[i].fetch_add(1); }, chunkWords);
+                for (std::size_t i = 0; i < v.size(); ++i)
+                    SV_CHECK(visits[i].load() == (v.exist_at(i) ? 1 : 0));
+                std::uint64_t seq = 0;
+                for (vector_type::iterator it = v.begin(); it != v.end(); ++it)
+                    seq += *it * 2;
+                const std::uint64_t par = sv::transform_reduce_live(policy, static_cast<const vector_type&>(v), std::uint64_t(0),
+                    [](std::uint64_t a, std::uint64_t b) { return a + b; },
+                    [](vector_type::size_type, std::uint64_t x) { return x * 2; }, chunkWords);
+                SV_CHECK(par == seq);
+            }
+        }
+        vector_type empty;
+        SV_CHECK(sv::transform_reduce_live(policy, static_cast<const vector_type&>(empty), std::uint64_t(7),
+            [](std::uint64_t a, std::uint64_t b) { return a + b; }, [](vector_type::size_type, std::uint64_t x) { return x; }, 0) == 7);
+    }
+};
+
+int main() {
+    test_policy(std::execution::seq);
+    test_policy(std::execution::par);
+    test_policy(thread_executor{ 4 });
+    std::puts("ok");
+    return 0;
+}
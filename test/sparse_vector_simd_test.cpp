@@ -0,0 +1,107 @@
+/*  sparse_vector_simd_test.cpp
+    Tests of the gather/scatter and reduce/count/any/transform kernels of sparse_vector_simd.hpp.
+
+    Build (C++11 or later, run it under the sanitizers, add -mavx512f to test the AVX-512 kernels):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. sparse_vector_simd_test.cpp -o sparse_vector_simd_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../sparse_vector_simd.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    // live values 1..count with every index % holeEvery == 0 erased, the erased slots keep a 0
+    template <class VectorT>
+    VectorT make_vector(std::size_t count, std::size_t holeEvery) {
+        VectorT v;
+        for (std::size_t i = 0; i < count; ++i)
+            v.push_free(typename VectorT::value_type(i % holeEvery == 0 ? 0 : i));
+        for (std::size_t i = 0; i < count; i += holeEvery)
+            v.erase_at(static_cast<typename VectorT::size_type>(i));
+        return v;
+    }
+
+    // functors run on live values only: a division by a zeroed hole or a call count past live_count() fails
+    template <class T, template <class, class> class FreeListT>
+    void test_user_code_sees_live_values(std::size_t count, std::size_t holeEvery) {
+        typedef sv::sparse_vector<T, std::allocator<T>, std::vector, sv::flat_bitmap, FreeListT> vector_type;
+        vector_type v = make_vector<vector_type>(count, holeEvery);
+        std::size_t calls = 0;
+        SV_CHECK(sv::count_if_live(v, [&calls](T x) { ++calls; return T(1000) / x > T(0); }) >= 0);
+        SV_CHECK(calls == v.live_count());
+        calls = 0;
+        SV_CHECK(!sv::any_of_live(v, [&calls](T x) { ++calls; return T(1000) / x < T(0); }));
+        SV_CHECK(calls == v.live_count());
+        sv::transform_live(v, [](T x) { return T(2 * x + T(0) / x); });
+        for (typename vector_type::iterator it = v.begin(); it != v.end(); ++it)
+            SV_CHECK(*it == T(2 * v.index_of(it)));
+        SV_CHECK(sv::reduce_live(v, T(1), [](T a, T b) { return T(a + T(0) / b); }) == T(1));
+    }
+
+    template <class T>
+    void test_builtin_reduce(std::size_t count, std::size_t holeEvery) {
+        typedef sv::sparse_vector<T> vector_type;
+        const vector_type v = make_vector<vector_type>(count, holeEvery);
+        T sum = 0, low = sv::min_op::identity<T>(), high = sv::max_op::identity<T>();
+        for (typename vector_type::const_iterator it = v.begin(); it != v.end(); ++it) {
+            sum += *it;
+            low = *it < low ? *it : low;
+            high = *it > high ? *it : high;
+        }
+        SV_CHECK(sv::reduce_live(v, T(0), sv::plus_op()) == sum); // small integers, exact in float too
+        SV_CHECK(sv::reduce_live(v, sv::min_op::identity<T>(), sv::min_op()) == low);
+        SV_CHECK(sv::reduce_live(v, sv::max_op::identity<T>(), sv::max_op()) == high);
+    }
+
+    void test_strings() {
+        sv::sparse_vector<std::string> v;
+        for (std::size_t i = 0; i < 200; ++i)
+            v.push_free(std::string(20, 'x') + std::to_string(i));
+        for (std::size_t i = 0; i < 200; i += 3)
+            v.erase_at(i);
+        SV_CHECK(sv::count_if_live(v, [](const std::string& s) { return s.size() == 22; }) == 60);
+        sv::transform_live(v, [](const std::string& s) { return s + "!"; });
+        SV_CHECK(sv::any_of_live(v, [](const std::string& s) { return s == std::string(20, 'x') + "199!"; }));
+    }
+
+    void test_gather_scatter() {
+        typedef sv::sparse_vector<std::int32_t> vector_type;
+        vector_type v = make_vector<vector_type>(1000, 7);
+        std::vector<std::int32_t> packed(v.live_count());
+        SV_CHECK(sv::gather_live(v, packed.data()) == v.live_count());
+        for (std::int32_t& x : packed)
+            x = -x;
+        SV_CHECK(sv::scatter_live(v, packed.data()) == v.live_count());
+        for (vector_type::iterator it = v.begin(); it != v.end(); ++it)
+            SV_CHECK(*it == -static_cast<std::int32_t>(v.index_of(it)));
+    }
+};
+
+int main() {
+    const std::size_t densities[] = { 2, 5, 64, 100, 1000 };
+    for (std::size_t holeEvery : densities) {
+        test_user_code_sees_live_values<std::int32_t, sv::stack_free_list>(1000, holeEvery);
+        test_user_code_sees_live_values<std::int64_t, sv::intrusive_free_list>(1000, holeEvery);
+        test_user_code_sees_live_values<double, sv::stack_free_list>(1000, holeEvery);
+        test_builtin_reduce<float>(1000, holeEvery);
+        test_builtin_reduce<double>(1000, holeEvery);
+        test_builtin_reduce<std::int32_t>(1000, holeEvery);
+        test_builtin_reduce<std::int64_t>(1000, holeEvery);
+        test_builtin_reduce<std::uint16_t>(1000, holeEvery);
+    }
+    test_strings();
+    test_gather_scatter();
+    std::puts("ok");
+    return 0;
+}
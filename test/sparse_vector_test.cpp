@@ -0,0 +1,661 @@
+/*  sparse_vector_test.cpp
+    Tests of sparse_vector for every free list and bitmap policy.
+
+    Build (C++11 or later, run it under the sanitizers):
+        c++ -std=c++11 -g -fsanitize=address,undefined -I.. sparse_vector_test.cpp -o sparse_vector_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../sparse_vector.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <string>
+#include <vector>
+
+#if (defined __cplusplus) && (__cplusplus >= 201703L) && (defined __has_include)
+#   if __has_include(<memory_resource>)
+#       include <memory_resource>
+#       define SV_TEST_PMR 1
+#   endif
+#endif
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    template <class T, template <class> class BitmapT, template <class, class> class FreeListT>
+    using vector_of = sv::sparse_vector<T, std::allocator<T>, std::vector, BitmapT, FreeListT>;
+
+    template <class T>
+    T value_of(std::size_t i) {
+        return static_cast<T>(i * 7 + 1);
+    }
+    template <>
+    std::string value_of<std::string>(std::size_t i) {
+        return std::string(24, static_cast<char>('a' + i % 26)) + std::to_string(i); // past the small string buffer
+    }
+
+    // a hole filled by emplace_at leaves the free list, no later insert lands on it
+    template <class VectorT>
+    void test_emplace_at_unlinks_hole() {
+        typedef typename VectorT::value_type value_type;
+        VectorT v;
+        for (std::size_t i = 0; i < 8; ++i)
+            v.push_free(value_of<value_type>(i));
+        v.erase_at(2);
+        v.erase_at(5);
+        v.erase_at(6);
+        v.emplace_at(5, value_of<value_type>(50));
+        const std::size_t a = v.push_free(value_of<value_type>(60));
+        const std::size_t b = v.push_free(value_of<value_type>(20));
+        SV_CHECK((a == 2 && b == 6) || (a == 6 && b == 2));
+        SV_CHECK(v.push_free(value_of<value_type>(80)) == 8);
+        SV_CHECK(v.at(5) == value_of<value_type>(50));
+        SV_CHECK(v.live_count() == 9 && v.free_count() == 0);
+    }
+
+    // holes cut off by pop_back stay listed above size(), growth must keep the list walkable
+    template <class VectorT>
+    void test_grow_after_pop_back() {
+        typedef typename VectorT::value_type value_type;
+        VectorT v;
+        for (std::size_t i = 0; i < 6; ++i)
+            v.push_free(value_of<value_type>(i));
+        v.erase_at(3);
+        v.erase_at(5);
+        v.pop_back();
+        v.reserve(1000);
+        SV_CHECK(v.push_free(value_of<value_type>(30)) == 3);
+        SV_CHECK(v.push_free(value_of<value_type>(50)) == 5);
+        SV_CHECK(v.live_count() == 6 && v.free_count() == 0);
+        for (std::size_t i = 0; i < 3; ++i)
+            SV_CHECK(v.at(i) == value_of<value_type>(i));
+    }
+
+    // shrinking below a hole cut off by pop_back
+    template <class VectorT>
+    void test_shrink_after_pop_back() {
+        typedef typename VectorT::value_type value_type;
+        VectorT v;
+        v.reserve(64);
+        for (std::size_t i = 0; i < 40; ++i)
+            v.push_free(value_of<value_type>(i));
+        v.erase_at(39);
+        v.erase_at(4);
+        for (std::size_t i = 0; i < 31; ++i)
+            v.pop_back();
+        v.shrink_to(9);
+        SV_CHECK(v.capacity() == 9 && v.size() == 9 && v.free_count() == 1);
+        SV_CHECK(v.push_free(value_of<value_type>(40)) == 4);
+        SV_CHECK(v.push_free(value_of<value_type>(90)) == 9);
+        v.erase_at(7);
+        v.pop_back();
+        v.pop_back();
+        v.shrink_to_fit();
+        SV_CHECK(v.capacity() == 7 && v.size() == 7 && v.free_count() == 0);
+        for (std::size_t i = 0; i < 7; ++i)
+            SV_CHECK(v.at(i) == value_of<value_type>(i == 4 ? 40 : i));
+    }
+
+    // copies keep the holes of the source, cut off ones included, and both reuse them the same way
+    template <class VectorT>
+    void test_copy_after_pop_back() {
+        typedef typename VectorT::value_type value_type;
+        VectorT v;
+        for (std::size_t i = 0; i < 6; ++i)
+            v.push_free(value_of<value_type>(i));
+        v.erase_at(3);
+        v.erase_at(5);
+        v.pop_back();
+        VectorT copy(v);
+        VectorT assigned;
+        assigned.push_free(value_of<value_type>(99));
+        assigned = v;
+        VectorT moved(SPARSE_VECTOR_MOVE(VectorT(v)));
+        VectorT* all[] = { &v, &copy, &assigned, &moved };
+        for (VectorT* c : all) {
+            SV_CHECK(c->size() == 5 && c->live_count() == 4);
+            SV_CHECK(c->push_free(value_of<value_type>(30)) == 3);
+            SV_CHECK(c->push_free(value_of<value_type>(50)) == 5);
+            SV_CHECK(c->push_free(value_of<value_type>(60)) == 6);
+            for (std::size_t i = 0; i < 7; ++i)
+                SV_CHECK(c->at(i) == value_of<value_type>(i == 3 ? 30 : i == 5 ? 50 : i == 6 ? 60 : i));
+        }
+    }
+
+    // iterators and begin_at visit exactly the live slots across word boundaries, erasing the current value while iterating is fine
+    template <class VectorT>
+    void test_iteration(std::size_t count, std::size_t keepEvery) {
+        typedef typename VectorT::value_type value_type;
+        typedef typename VectorT::size_type size_type;
+        VectorT v;
+        for (std::size_t i = 0; i < count; ++i)
+            v.push_free(value_of<value_type>(i));
+        for (std::size_t i = 0; i < count; ++i) {
+            if (i % keepEvery != 0)
+                v.erase_at(static_cast<size_type>(i));
+        }
+        std::size_t expected = 0;
+        for (typename VectorT::const_iterator it = static_cast<const VectorT&>(v).begin(); it != static_cast<const VectorT&>(v).end(); ++it, expected += keepEvery) {
+            SV_CHECK(v.index_of(it) == expected && *it == value_of<value_type>(expected));
+        }
+        SV_CHECK(expected == (count + keepEvery - 1) / keepEvery * keepEvery);
+        const size_type first = static_cast<size_type>(count / 3), last = static_cast<size_type>(count - count / 5);
+        expected = (first + keepEvery - 1) / keepEvery * keepEvery;
+        for (typename VectorT::iterator it = v.begin_at(first, last); it != v.end_at(last); ++it, expected += keepEvery)
+            SV_CHECK(v.index_of(it) == expected);
+        SV_CHECK(expected >= last && expected < last + keepEvery);
+        for (typename VectorT::iterator it = v.begin(); it != v.end();) {
+            const size_type index = v.index_of(it);
+            ++it;
+            v.erase_at(index);
+        }
+        SV_CHECK(v.live_count() == 0);
+    }
+
+    int alive = 0;
+    int budget = -1;
+    void spend() {
+        if (budget >= 0 && budget-- == 0)
+            throw std::runtime_error("throwing");
+    }
+    // counts live objects, the move throws once the budget runs out
+    struct throwing_move {
+        std::size_t value;
+
+        explicit throwing_move(std::size_t v) : value(v) {
+            ++alive;
+        }
+        throwing_move(throwing_move&& other) : value(other.value) {
+            spend();
+            other.value = 0;
+            ++alive;
+        }
+        ~throwing_move() {
+            --alive;
+        }
+    };
+    // copyable too, growth copies it and keeps every value on a throw
+    struct throwing_copy : throwing_move {
+        explicit throwing_copy(std::size_t v) : throwing_move(v) {
+        }
+        throwing_copy(const throwing_copy& other) : throwing_move(0) {
+            spend();
+            value = other.value;
+        }
+        throwing_copy(throwing_copy&& other) : throwing_move(SPARSE_VECTOR_MOVE(other)) {
+        }
+    };
+
+    // a throw in the middle of growth leaves the old storage in place, nothing leaks or is destroyed twice,
+    // values that can be copied are all kept
+    template <class T, template <class> class BitmapT, template <class, class> class FreeListT>
+    void test_grow_throws() {
+        {
+            vector_of<T, BitmapT, FreeListT> v;
+            for (std::size_t i = 0; i < 8; ++i)
+                v.emplace_free(i + 1);
+            v.erase_at(2);
+            const std::size_t capacity = v.capacity();
+            budget = 3;
+            bool threw = false;
+            try {
+                v.reserve(100);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            budget = -1;
+            SV_CHECK(threw && v.capacity() == capacity && v.live_count() == 7 && alive == 7);
+            for (std::size_t i = 0; i < 8; ++i) {
+                SV_CHECK(v.exist_at(i) == (i != 2));
+                if (std::is_copy_constructible<T>::value && i != 2)
+                    SV_CHECK(v.at(i).value == i + 1);
+            }
+            v.reserve(100);
+            SV_CHECK(v.capacity() >= 100 && v.emplace_free(30) == 2 && v.at(2).value == 30 && alive == 8);
+        }
+        SV_CHECK(alive == 0);
+    }
+
+    // a value that throws while it is built gives its hole back, or leaves size() alone at the tail
+    template <template <class> class BitmapT, template <class, class> class FreeListT>
+    void test_insert_throws() {
+        {
+            typedef vector_of<throwing_copy, BitmapT, FreeListT> vector_type;
+            vector_type v;
+            for (std::size_t i = 0; i < 8; ++i)
+                v.emplace_free(i + 1);
+            v.erase_at(2);
+            v.erase_at(5);
+            const throwing_copy value(50);
+            std::vector<std::size_t> indices;
+            for (int round = 0; round < 4; ++round) {
+                budget = 0;
+                try {
+                    if (round == 0)
+                        v.push_free(value);
+                    else if (round == 1)
+                        v.emplace_free(value);
+                    else if (round == 2)
+                        v.push_free_n(2, value, std::back_inserter(indices));
+                    else
+                        v.emplace_range(&value, &value + 1, std::back_inserter(indices));
+                } catch (const std::runtime_error&) {
+                }
+                budget = -1;
+                SV_CHECK(v.size() == 8 && v.live_count() == 6 && alive == 7);
+            }
+            SV_CHECK(indices.empty());
+            const std::size_t a = v.push_free(value), b = v.push_free(value);
+            SV_CHECK((a == 2 && b == 5) || (a == 5 && b == 2));
+            v.reserve(100); // growth copies too
+            budget = 2;
+            try {
+                v.push_free_n(5, value, std::back_inserter(indices));
+            } catch (const std::runtime_error&) {
+            }
+            budget = -1;
+            SV_CHECK(indices.size() == 2 && indices[0] == 8 && indices[1] == 9);
+            SV_CHECK(v.size() == 10 && v.live_count() == 10 && v.free_count() == 0);
+        }
+        SV_CHECK(alive == 0);
+    }
+
+    // capacity after each reallocation is what GrowthT asked for, values survive every growth
+    template <class GrowthT>
+    void test_growth(std::size_t count) {
+        typedef sv::sparse_vector<std::uint64_t, std::allocator<std::uint64_t>, std::vector, sv::flat_bitmap, sv::stack_free_list, GrowthT> vector_type;
+        vector_type v;
+        std::size_t capacity = v.capacity();
+        std::size_t reallocations = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            v.push_free(value_of<std::uint64_t>(i));
+            if (v.capacity() != capacity) {
+                SV_CHECK(v.capacity() == GrowthT::next_capacity(capacity, sizeof(std::uint64_t)));
+                capacity = v.capacity();
+                ++reallocations;
+            }
+        }
+        SV_CHECK(reallocations != 0 && v.live_count() == count);
+        for (std::size_t i = 0; i < count; ++i)
+            SV_CHECK(v[i] == value_of<std::uint64_t>(i));
+    }
+    void test_growth_policies() {
+        SV_CHECK(sv::factor_growth<3, 2>::next_capacity(0, 8) == 2 && sv::factor_growth<3, 2>::next_capacity(1, 8) == 3);
+        SV_CHECK(sv::factor_growth<3, 2>::next_capacity(100, 8) == 150 && sv::factor_growth<5, 4>::next_capacity(7, 8) == 9);
+        SV_CHECK(sv::fixed_growth<10>::next_capacity(0, 8) == 10 && sv::fixed_growth<10>::next_capacity(25, 8) == 35);
+        typedef sv::page_rounded_growth<sv::doubling_growth, 4096> page_growth;
+        SV_CHECK(page_growth::next_capacity(2, 8) == 4 && page_growth::next_capacity(256, 8) == 512);
+        SV_CHECK(page_growth::next_capacity(300, 8) == 1024 && page_growth::next_capacity(300, 24) == 682);
+        test_growth<sv::doubling_growth>(3000);
+        test_growth<sv::factor_growth<3, 2>>(3000);
+        test_growth<sv::fixed_growth<100>>(3000);
+        test_growth<page_growth>(3000);
+        test_growth<sv::page_rounded_growth<>>(300000);
+    }
+
+    // caller indices wider than size_type are reported, not cut down onto another slot
+    void test_wide_indices() {
+        typedef sv::sparse_vector<std::uint64_t, std::allocator<std::uint64_t>, std::vector, sv::flat_bitmap, sv::stack_free_list, sv::doubling_growth, std::uint16_t> vector_type;
+        vector_type v;
+        for (std::size_t i = 0; i < 10; ++i)
+            v.push_free(i);
+        const std::uint64_t wide[] = { 1, 65536 + 3 };
+        const int negative[] = { -1 };
+        bool threw = false;
+        try {
+            v.erase_batch(wide, wide + 2);
+        } catch (const std::out_of_range&) {
+            threw = true;
+        }
+        SV_CHECK(threw && !v.exist_at(1) && v.exist_at(3) && v.live_count() == 9);
+        threw = false;
+        try {
+            v.erase_batch(negative, negative + 1);
+        } catch (const std::out_of_range&) {
+            threw = true;
+        }
+        SV_CHECK(threw && v.live_count() == 9);
+
+        const std::uint64_t words[] = { 0x5 }; // 0 and 2 live, 1 a hole
+        const std::uint64_t holes[] = { 65536 + 1 };
+        threw = false;
+        try {
+            v.restore(3, words, holes, holes + 1, [](std::uint64_t* p, vector_type::size_type i) { new(p)std::uint64_t(i); });
+        } catch (const std::out_of_range&) {
+            threw = true;
+        }
+        SV_CHECK(threw && v.size() == 10 && v.live_count() == 9 && v.at(3) == 3);
+        const std::uint64_t hole[] = { 1 };
+        v.restore(3, words, hole, hole + 1, [](std::uint64_t* p, vector_type::size_type i) { new(p)std::uint64_t(i * 10); });
+        SV_CHECK(v.size() == 3 && v.live_count() == 2 && v.at(2) == 20 && v.push_free(7) == 1);
+    }
+
+#if (defined SV_TEST_PMR)
+    // counts what reaches the arena, the default resource is the null one so a stray std allocation throws
+    struct counting_resource : std::pmr::memory_resource {
+        std::pmr::memory_resource* upstream;
+        std::size_t allocations;
+
+        explicit counting_resource(std::pmr::memory_resource* upstream) : upstream(upstream), allocations(0) {
+        }
+
+        private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+            ++allocations;
+            return upstream->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+            upstream->deallocate(p, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+    // stack_free_list keeps its indices in a container, it has to take them from the same arena
+    void test_pmr() {
+        typedef sv::pmr::sparse_vector<std::uint64_t, sv::flat_bitmap, sv::stack_free_list> vector_type;
+        static unsigned char buffer[1 << 16];
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+        counting_resource counting(&arena);
+        std::pmr::memory_resource* const previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+        {
+            vector_type v(&counting);
+            SV_CHECK(v.get_allocator().resource() == &counting);
+            for (std::uint64_t i = 0; i < 1000; ++i)
+                v.push_free(i);
+            const std::size_t capacity = v.capacity();
+            const std::size_t afterPush = counting.allocations;
+            for (std::uint64_t i = 0; i < 999; i += 2)
+                v.erase_at(i);
+            SV_CHECK(v.capacity() == capacity && counting.allocations > afterPush); // only the free indices grew
+            for (std::uint64_t i = 0; i < 500; ++i)
+                SV_CHECK(v.push_free(i) % 2 == 0);
+            SV_CHECK(v.live_count() == 1000);
+
+            vector_type copy(v, &counting);
+            SV_CHECK(copy.get_allocator().resource() == &counting && copy.live_count() == 1000);
+        }
+        std::pmr::set_default_resource(previous);
+    }
+#endif
+
+    // forward iterator seen as a single pass one, takes emplace_range down its value by value path
+    template <class It>
+    struct input_only {
+        typedef std::input_iterator_tag iterator_category;
+        typedef typename std::iterator_traits<It>::value_type value_type;
+        typedef typename std::iterator_traits<It>::difference_type difference_type;
+        typedef typename std::iterator_traits<It>::pointer pointer;
+        typedef typename std::iterator_traits<It>::reference reference;
+
+        It it;
+
+        reference operator*() const {
+            return *it;
+        }
+        input_only& operator++() {
+            ++it;
+            return *this;
+        }
+        bool operator==(const input_only& other) const {
+            return it == other.it;
+        }
+        bool operator!=(const input_only& other) const {
+            return it != other.it;
+        }
+    };
+
+    // a new value at index i, holes below size are reused before the tail grows
+    template <class T>
+    void model_insert(std::map<std::size_t, T>& model, std::size_t& size, std::size_t i, const T& value) {
+        SV_CHECK(model.count(i) == 0);
+        SV_CHECK(model.size() < size ? i < size : i == size);
+        model[i] = value;
+        if (i == size)
+            ++size;
+    }
+
+    template <class VectorT>
+    void check_model(const VectorT& v, const std::map<std::size_t, typename VectorT::value_type>& model, std::size_t size) {
+        SV_CHECK(v.size() == size && v.live_count() == model.size() && v.free_count() == size - model.size());
+        SV_CHECK(v.capacity() >= size);
+        typename std::map<std::size_t, typename VectorT::value_type>::const_iterator expected = model.begin();
+        for (std::size_t i = 0; i < size; ++i) {
+            const bool live = expected != model.end() && expected->first == i;
+            SV_CHECK(v.exist_at(static_cast<typename VectorT::size_type>(i)) == live);
+            if (live) {
+                SV_CHECK(v[static_cast<typename VectorT::size_type>(i)] == expected->second);
+                ++expected;
+            }
+        }
+        SV_CHECK(!v.exist_at(static_cast<typename VectorT::size_type>(size)));
+    }
+
+    template <class SizeT>
+    using tracked_hierarchical_bitmap = sv::change_tracking_bitmap<SizeT, sv::hierarchical_bitmap<SizeT>>;
+
+    // a replica that takes size() and then the dirty slots stays equal to the vector, clear marks its slots dirty
+    template <class VectorT>
+    void test_replica(std::uint64_t seed) {
+        typedef typename VectorT::value_type value_type;
+        typedef typename VectorT::size_type size_type;
+        std::mt19937_64 random(seed);
+        VectorT v;
+        std::map<std::size_t, value_type> replica;
+        std::size_t next = 0;
+        for (std::size_t step = 0; step < 3000; ++step) {
+            const std::size_t pick = random() % 100;
+            const size_type at = static_cast<size_type>(v.size() != 0 ? random() % v.size() : 0);
+            if (pick < 40) {
+                v.push_free(value_of<value_type>(next++));
+            } else if (pick < 62) {
+                if (v.exist_at(at))
+                    v.erase_at(at);
+            } else if (pick < 70) {
+                if (v.size() != 0 && !v.exist_at(at))
+                    v.emplace_at(at, value_of<value_type>(next++));
+            } else if (pick < 80) {
+                if (v.exist_at(at))
+                    v[at] = value_of<value_type>(next++); // mutable operator[] touches
+            } else if (pick < 85) {
+                if (v.size() != 0)
+                    v.pop_back();
+            } else if (pick < 89) {
+                v.resize(static_cast<size_type>(random() % (v.size() + 20)));
+            } else if (pick < 91) {
+                const size_type size = v.size();
+                v.clear_dirty();
+                v.clear();
+                for (size_type i = 0; i < size; ++i)
+                    SV_CHECK(v.get_bitmap().is_dirty(i));
+            } else {
+                replica.erase(replica.lower_bound(v.size()), replica.end());
+                v.for_each_dirty([&v, &replica](size_type i) {
+                    if (v.exist_at(i))
+                        replica[i] = v[i];
+                    else
+                        replica.erase(i);
+                });
+                v.clear_dirty();
+                check_model(v, replica, v.size());
+            }
+        }
+    }
+
+    // random operations against a std::map model, the contents are checked after every step
+    template <class VectorT>
+    void test_against_model(std::uint64_t seed, std::size_t steps) {
+        typedef typename VectorT::value_type value_type;
+        typedef typename VectorT::size_type size_type;
+        std::mt19937_64 random(seed);
+        VectorT v;
+        std::map<std::size_t, value_type> model;
+        std::size_t size = 0;
+        std::size_t next = 0;
+        for (std::size_t step = 0; step < steps; ++step) {
+            const std::size_t pick = random() % 130;
+            const std::size_t at = size != 0 ? random() % size : 0;
+            if (pick < 35) {
+                const value_type value = value_of<value_type>(next++);
+                model_insert(model, size, pick < 25 ? v.push_free(value) : v.emplace_free(value), value);
+            } else if (pick < 60) {
+                if (!model.empty()) {
+                    typename std::map<std::size_t, value_type>::iterator it = model.lower_bound(at);
+                    if (it == model.end())
+                        it = model.begin();
+                    v.erase_at(static_cast<size_type>(it->first));
+                    model.erase(it);
+                }
+            } else if (pick < 68) {
+                if (size != 0 && model.count(at) == 0) {
+                    const value_type value = value_of<value_type>(next++);
+                    v.emplace_at(static_cast<size_type>(at), value);
+                    model[at] = value;
+                }
+            } else if (pick < 78) {
+                if (size != 0) {
+                    v.pop_back();
+                    model.erase(--size);
+                }
+            } else if (pick < 81) {
+                v.reserve(size + random() % 200);
+            } else if (pick < 84) {
+                v.shrink_to(static_cast<size_type>(random() % (size + 10)));
+            } else if (pick < 86) {
+                v.shrink_to_fit();
+                size = model.empty() ? 0 : model.rbegin()->first + 1;
+            } else if (pick < 89) {
+                v.trim_trailing_holes();
+                size = model.empty() ? 0 : model.rbegin()->first + 1;
+            } else if (pick < 92) {
+                const std::size_t count = random() % (size + 20);
+                v.resize(static_cast<size_type>(count));
+                model.erase(model.lower_bound(count), model.end());
+                size = count;
+            } else if (pick < 96) {
+                VectorT copy(v);
+                check_model(copy, model, size);
+                v = copy;
+            } else if (pick < 99) {
+                VectorT moved(SPARSE_VECTOR_MOVE(v));
+                v = SPARSE_VECTOR_MOVE(moved);
+            } else if (pick < 100) {
+                v.clear();
+                model.clear();
+                size = 0;
+            } else if (pick < 106) {
+                const value_type value = value_of<value_type>(next++);
+                std::vector<size_type> indices;
+                v.push_free_n(random() % 80, value, std::back_inserter(indices));
+                for (size_type i : indices)
+                    model_insert(model, size, i, value);
+            } else if (pick < 112) {
+                std::vector<value_type> values;
+                for (std::size_t k = random() % 80; k != 0; --k)
+                    values.push_back(value_of<value_type>(next++));
+                std::vector<size_type> indices;
+                if (pick < 109) {
+                    v.emplace_range(values.begin(), values.end(), std::back_inserter(indices));
+                } else {
+                    typedef input_only<typename std::vector<value_type>::const_iterator> input_type;
+                    const input_type first = { values.begin() }, last = { values.end() };
+                    v.emplace_range(first, last, std::back_inserter(indices));
+                }
+                SV_CHECK(indices.size() == values.size());
+                for (std::size_t k = 0; k < indices.size(); ++k)
+                    model_insert(model, size, indices[k], values[k]);
+            } else if (pick < 120) {
+                std::vector<std::size_t> erased;
+                for (typename std::map<std::size_t, value_type>::iterator it = model.lower_bound(at); it != model.end() && erased.size() < 6; ++it) {
+                    if (random() % 2)
+                        erased.push_back(it->first);
+                }
+                v.erase_batch(erased.begin(), erased.end());
+                for (std::size_t i : erased)
+                    model.erase(i);
+            } else { // compact, or a few steps of it that later steps interleave with everything else
+                std::vector<std::pair<std::size_t, std::size_t>> moves;
+                const auto remap = [&moves](size_type from, size_type to) { moves.push_back(std::make_pair(std::size_t(from), std::size_t(to))); };
+                const std::size_t live = model.size();
+                bool done = true;
+                if (pick < 123)
+                    v.compact(remap);
+                else
+                    done = v.compact_step(static_cast<size_type>(1 + random() % 4), remap);
+                for (const std::pair<std::size_t, std::size_t>& move : moves) {
+                    SV_CHECK(move.first > move.second && model.count(move.first) == 1 && model.count(move.second) == 0);
+                    model[move.second] = model[move.first];
+                    model.erase(move.first);
+                }
+                size = model.empty() ? 0 : model.rbegin()->first + 1;
+                SV_CHECK(done == (size == live));
+                if (pick < 123)
+                    SV_CHECK(size == live);
+            }
+            check_model(v, model, size);
+        }
+    }
+
+    template <template <class> class BitmapT, template <class, class> class FreeListT>
+    void test_policy() {
+        const std::size_t densities[] = { 1, 2, 10, 63, 64, 65, 100 };
+        for (std::size_t keepEvery : densities) {
+            test_iteration<vector_of<std::uint64_t, BitmapT, FreeListT>>(1000, keepEvery);
+            test_iteration<vector_of<std::string, BitmapT, FreeListT>>(300, keepEvery);
+            test_iteration<sv::sparse_vector<std::uint64_t, std::allocator<std::uint64_t>, std::vector, BitmapT, FreeListT, sv::doubling_growth, std::uint8_t>>(254, keepEvery);
+            test_iteration<sv::sparse_vector<std::uint64_t, std::allocator<std::uint64_t>, std::vector, BitmapT, FreeListT, sv::doubling_growth, std::uint16_t>>(1000, keepEvery);
+        }
+        test_emplace_at_unlinks_hole<vector_of<std::uint64_t, BitmapT, FreeListT>>();
+        test_emplace_at_unlinks_hole<vector_of<std::string, BitmapT, FreeListT>>();
+        test_grow_after_pop_back<vector_of<std::uint64_t, BitmapT, FreeListT>>();
+        test_grow_after_pop_back<vector_of<std::string, BitmapT, FreeListT>>();
+        test_grow_after_pop_back<sv::sparse_vector<std::uint64_t, sv::malloc_allocator<std::uint64_t>, std::vector, BitmapT, FreeListT>>();
+        test_shrink_after_pop_back<vector_of<std::uint64_t, BitmapT, FreeListT>>();
+        test_shrink_after_pop_back<vector_of<std::string, BitmapT, FreeListT>>();
+        test_shrink_after_pop_back<sv::sparse_vector<std::uint64_t, sv::malloc_allocator<std::uint64_t>, std::vector, BitmapT, FreeListT>>();
+        test_copy_after_pop_back<vector_of<std::uint64_t, BitmapT, FreeListT>>();
+        test_copy_after_pop_back<vector_of<std::string, BitmapT, FreeListT>>();
+        test_grow_throws<throwing_move, BitmapT, FreeListT>();
+        test_grow_throws<throwing_copy, BitmapT, FreeListT>();
+        test_insert_throws<BitmapT, FreeListT>();
+        for (std::uint64_t seed = 1; seed <= 4; ++seed) {
+            test_against_model<vector_of<std::uint64_t, BitmapT, FreeListT>>(seed, 3000);
+            test_against_model<vector_of<std::string, BitmapT, FreeListT>>(seed, 3000);
+        }
+        test_against_model<sv::sparse_vector<std::uint64_t, sv::malloc_allocator<std::uint64_t>, std::vector, BitmapT, FreeListT>>(5, 3000);
+    }
+    template <template <class> class BitmapT>
+    void test_bitmap() {
+        test_policy<BitmapT, sv::stack_free_list>();
+        test_policy<BitmapT, sv::intrusive_free_list>();
+        test_policy<BitmapT, sv::lowest_index_free_list>();
+    }
+};
+
+int main() {
+    test_growth_policies();
+    test_wide_indices();
+#if (defined SV_TEST_PMR)
+    test_pmr();
+#endif
+    test_replica<vector_of<std::uint64_t, sv::tracked_flat_bitmap, sv::stack_free_list>>(1);
+    test_replica<vector_of<std::string, sv::tracked_flat_bitmap, sv::intrusive_free_list>>(2);
+    test_replica<vector_of<std::uint64_t, tracked_hierarchical_bitmap, sv::lowest_index_free_list>>(3);
+    test_bitmap<sv::flat_bitmap>();
+    test_bitmap<sv::hierarchical_bitmap>();
+    test_bitmap<sv::dense_index_bitmap>();
+    test_bitmap<sv::tracked_flat_bitmap>();
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*  static_sparse_vector_test.cpp
+    Tests of static_sparse_vector hole reuse, iteration and, under C++20, constant evaluation.
+
+    Build (C++11 or later, C++20 for the constexpr checks, run it under the sanitizers):
+        c++ -std=c++20 -g -fsanitize=address,undefined -I.. static_sparse_vector_test.cpp -o static_sparse_vector_test
+    Prints the failed check and exits with 1, prints "ok" otherwise.
+*/
+
+#include "../static_sparse_vector.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define SV_CHECK(...) ((__VA_ARGS__) ? static_cast<void>(0) : fail(__FILE__, __LINE__, #__VA_ARGS__))
+
+namespace {
+    void fail(const char* file, int line, const char* what) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(1);
+    }
+
+    // a hole filled by emplace_at leaves the free list, refilling the same hole over and over never overflows it
+    void test_emplace_at_unlists_hole() {
+        sv::static_sparse_vector<int, 2> v;
+        v.push_free(1);
+        v.push_free(2);
+        for (int k = 0; k < 100; ++k) {
+            v.erase_at(0);
+            v.emplace_at(0, k);
+        }
+        SV_CHECK(v.at(0) == 99 && v.live_count() == 2 && v.free_count() == 0);
+        v.erase_at(1);
+        v.erase_at(0);
+        v.emplace_at(1, 7);
+        SV_CHECK(v.push_free(8) == 0);
+        SV_CHECK(v.full() && v.at(1) == 7 && v.at(0) == 8);
+        bool threw = false;
+        try {
+            v.push_free(9);
+        } catch (const std::length_error&) {
+            threw = true;
+        }
+        SV_CHECK(threw);
+    }
+
+    // holes cut off by pop_back are skipped, indices above size() are appended again
+    void test_pop_back_cuts_holes() {
+        sv::static_sparse_vector<std::string, 8> v;
+        for (std::size_t i = 0; i < 8; ++i)
+            v.push_free(std::string(24, static_cast<char>('a' + i)));
+        v.erase_at(6);
+        v.erase_at(2);
+        v.pop_back();
+        v.pop_back();
+        SV_CHECK(v.size() == 6 && v.live_count() == 5);
+        SV_CHECK(v.push_free("two") == 2);
+        SV_CHECK(v.push_free("six") == 6);
+        SV_CHECK(v.push_free("seven") == 7);
+        SV_CHECK(v.full() && v.at(6) == "six");
+    }
+
+    // iterators visit exactly the live slots
+    void test_iteration() {
+        sv::static_sparse_vector<std::size_t, 200> v;
+        for (std::size_t i = 0; i < 200; ++i)
+            v.push_free(i);
+        for (std::size_t i = 0; i < 200; ++i) {
+            if (i % 65 != 0)
+                v.erase_at(i);
+        }
+        std::size_t expected = 0;
+        for (sv::static_sparse_vector<std::size_t, 200>::iterator it = v.begin(); it != v.end(); ++it, expected += 65)
+            SV_CHECK(v.index_of(it) == expected && *it == expected);
+        SV_CHECK(expected == 260);
+    }
+
+#if ((defined __cplusplus) && (__cplusplus >= 202002L))
+    constexpr int reuse_and_sum() {
+        sv::static_sparse_vector<int, 4> v;
+        for (int i = 0; i < 4; ++i)
+            v.push_free(i + 1);
+        for (int k = 0; k < 10; ++k) {
+            v.erase_at(2);
+            v.emplace_at(2, 30);
+        }
+        v.erase_at(1);
+        int sum = 0;
+        for (const int value : v)
+            sum += value;
+        return sum + static_cast<int>(v.find_next_live(1)) * 100;
+    }
+    static_assert(reuse_and_sum() == 1 + 30 + 4 + 200, "static_sparse_vector iteration in constant evaluation.");
+#endif
+};
+
+int main() {
+    test_emplace_at_unlists_hole();
+    test_pop_back_cuts_holes();
+    test_iteration();
+    std::puts("ok");
+    return 0;
+}